@@ -0,0 +1,84 @@
+/*
+ * ButtonPulse - one timed press on an output line
+ *
+ * start() raises the line and arms a one-shot timer. When the timer expires
+ * its callback calls expire(), which drops the line and reports completion,
+ * so the pulse width is set by the timer and not by when the caller next
+ * gets the CPU. The timer and the line sit behind two small interfaces so
+ * the sequence can be run on the host against a mock timer
+ * (test/test_button_pulse).
+ *
+ * expire() may run in a different task than start() and abort(); the
+ * caller must not start a new pulse before the previous one completed or
+ * was aborted.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class PulseTimer {
+ public:
+  // Arms a one-shot expiry in us microseconds; false if that failed
+  virtual bool arm(uint32_t us) = 0;
+  // Disarms a pending expiry; false if there was none
+  virtual bool disarm() = 0;
+
+ protected:
+  ~PulseTimer() {}
+};
+
+class PulseLine {
+ public:
+  virtual void set(bool high) = 0;
+
+ protected:
+  ~PulseLine() {}
+};
+
+class ButtonPulse {
+ public:
+  typedef void (*Completion)(void* context);
+
+  ButtonPulse(PulseTimer& timer, PulseLine& line, Completion done, void* context)
+      : timer_(timer), line_(line), done_(done), context_(context), active_(false) {}
+
+  // Starts a pulse of widthMs; false if one is running or the timer could
+  // not be armed (the line is left low then)
+  bool start(uint32_t widthMs) {
+    if (active_) return false;
+    active_ = true;
+    line_.set(true);
+    if (!timer_.arm(widthMs * 1000UL)) {
+      line_.set(false);
+      active_ = false;
+      return false;
+    }
+    return true;
+  }
+
+  // Timer expiry: ends the pulse and reports completion
+  void expire() {
+    if (!active_) return;
+    line_.set(false);
+    active_ = false;
+    if (done_) done_(context_);
+  }
+
+  // Ends the pulse without reporting completion, for a timer that never
+  // fired
+  void abort() {
+    timer_.disarm();
+    if (!active_) return;
+    line_.set(false);
+    active_ = false;
+  }
+
+  bool active() const { return active_; }
+
+ private:
+  PulseTimer& timer_;
+  PulseLine& line_;
+  Completion done_;
+  void* context_;
+  volatile bool active_;
+};
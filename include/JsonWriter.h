@@ -0,0 +1,226 @@
+/*
+ * JsonWriter - minimal streaming JSON writer
+ *
+ * Output goes into a caller-supplied fixed buffer. When the buffer fills up
+ * it is handed to a JsonSink and reused, so a response of any size is built
+ * without touching the heap. Without a sink the writer just fills the buffer
+ * and reports overflow.
+ *
+ * Keys must be string literals: they are written verbatim with their length
+ * taken from the array type, so they are never scanned or escaped at run
+ * time. String values are escaped.
+ *
+ * Commas are inserted automatically; nesting is not checked.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+class JsonSink {
+ public:
+  // Receives each full buffer with last = false, then whatever remains
+  // from finish() with last = true
+  virtual void write(const char* data, size_t len, bool last) = 0;
+
+ protected:
+  ~JsonSink() {}
+};
+
+class JsonWriter {
+ public:
+  JsonWriter(char* buf, size_t cap, JsonSink* sink = nullptr)
+      : buf_(buf), cap_(cap), used_(0), flushed_(0), sink_(sink), needComma_(false), overflow_(false) {}
+
+  JsonWriter& beginObject() {
+    separate();
+    put('{');
+    needComma_ = false;
+    return *this;
+  }
+
+  JsonWriter& endObject() {
+    put('}');
+    needComma_ = true;
+    return *this;
+  }
+
+  JsonWriter& beginArray() {
+    separate();
+    put('[');
+    needComma_ = false;
+    return *this;
+  }
+
+  JsonWriter& endArray() {
+    put(']');
+    needComma_ = true;
+    return *this;
+  }
+
+  // Continues an object or array whose opening part was written elsewhere:
+  // the next member gets a leading comma
+  JsonWriter& resume() {
+    needComma_ = true;
+    return *this;
+  }
+
+  template <size_t N>
+  JsonWriter& key(const char (&name)[N]) {
+    separate();
+    put('"');
+    append(name, N - 1);
+    append("\":", 2);
+    needComma_ = false;
+    return *this;
+  }
+
+  JsonWriter& value(const char* text) {
+    separate();
+    if (!text) {
+      append("null", 4);
+    } else {
+      put('"');
+      escape(text);
+      put('"');
+    }
+    needComma_ = true;
+    return *this;
+  }
+
+  JsonWriter& value(bool flag) {
+    separate();
+    if (flag) {
+      append("true", 4);
+    } else {
+      append("false", 5);
+    }
+    needComma_ = true;
+    return *this;
+  }
+
+  JsonWriter& value(long number) {
+    separate();
+    if (number < 0) {
+      put('-');
+      writeNumber(0UL - (unsigned long)number);
+    } else {
+      writeNumber((unsigned long)number);
+    }
+    needComma_ = true;
+    return *this;
+  }
+
+  JsonWriter& value(unsigned long number) {
+    separate();
+    writeNumber(number);
+    needComma_ = true;
+    return *this;
+  }
+
+  JsonWriter& value(int number) { return value((long)number); }
+  JsonWriter& value(unsigned number) { return value((unsigned long)number); }
+
+  JsonWriter& null() {
+    separate();
+    append("null", 4);
+    needComma_ = true;
+    return *this;
+  }
+
+  // Appends an already serialized value, e.g. a cached fragment
+  JsonWriter& raw(const char* json, size_t len) {
+    separate();
+    append(json, len);
+    needComma_ = true;
+    return *this;
+  }
+
+  // Terminates the document with a newline and hands the rest to the sink.
+  // Returns the total length written.
+  size_t finish() {
+    put('\n');
+    size_t total = flushed_ + used_;
+    if (sink_) {
+      sink_->write(buf_, used_, true);
+      flushed_ += used_;
+      used_ = 0;
+    }
+    return total;
+  }
+
+  // Bytes currently in the buffer (the whole output when there is no sink)
+  size_t length() const { return used_; }
+  bool overflowed() const { return overflow_; }
+
+ private:
+  char* buf_;
+  size_t cap_;
+  size_t used_;
+  size_t flushed_;
+  JsonSink* sink_;
+  bool needComma_;
+  bool overflow_;
+
+  void separate() {
+    if (needComma_) put(',');
+  }
+
+  void flush() {
+    if (!sink_) {
+      overflow_ = true;
+      return;
+    }
+    sink_->write(buf_, used_, false);
+    flushed_ += used_;
+    used_ = 0;
+  }
+
+  void put(char c) {
+    if (used_ == cap_) flush();
+    if (used_ < cap_) buf_[used_++] = c;
+  }
+
+  void append(const char* data, size_t len) {
+    while (len > 0) {
+      if (used_ == cap_) {
+        flush();
+        if (used_ == cap_) return;
+      }
+      size_t n = cap_ - used_ < len ? cap_ - used_ : len;
+      memcpy(buf_ + used_, data, n);
+      used_ += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void escape(const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    const char* run = text;
+    for (const char* p = text; *p; p++) {
+      unsigned char c = *p;
+      if (c != '"' && c != '\\' && c >= 0x20) continue;
+      append(run, p - run);
+      run = p + 1;
+      if (c == '"' || c == '\\') {
+        put('\\');
+        put(c);
+      } else {
+        char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+        append(esc, sizeof(esc));
+      }
+    }
+    append(run, strlen(run));
+  }
+
+  void writeNumber(unsigned long number) {
+    char digits[20];
+    size_t n = 0;
+    do {
+      digits[n++] = '0' + number % 10;
+      number /= 10;
+    } while (number > 0);
+    while (n > 0) put(digits[--n]);
+  }
+};
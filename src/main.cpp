@@ -3,7 +3,7 @@
  * 
  * Hardware connections:
  *   - GPIO25: Relay control (ACTIVE LOW - LOW=ON, HIGH=OFF)
- *   - GPIO32: LED sense input (digital read, 3V when AC on, 0V when off)
+ *   - GPIO32: LED sense input (edge interrupt, 3V when AC on, 0V when off)
  *   - VIN: Relay module power
  *   - GND: Shared ground
  * 
@@ -18,31 +18,123 @@
 #include <WebServer.h>
 #include <time.h>
 #include <esp_sntp.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <sys/time.h>
+#include <lwip/sockets.h>
 #include <Preferences.h>
+#include <freertos/queue.h>
+#include "JsonWriter.h"
+#include "ButtonPulse.h"
+
+// Keep the journal on LittleFS as well as in RAM (set in platformio.ini)
+#ifndef JOURNAL_PERSIST
+#define JOURNAL_PERSIST 0
+#endif
+
+#if JOURNAL_PERSIST
+#include <LittleFS.h>
+#endif
 
 // Time configuration
 const char* NTP_SERVER = "pool.ntp.org";
 const long  GMT_OFFSET_SEC = -5 * 3600;      // GMT-5 (Eastern US)
 const int   DAYLIGHT_OFFSET_SEC = 0;
 
-// Schedule structure
-struct Schedule {
-  int id;
-  int hour;
-  int minute;
-  int switchState;  // 1 = turn on, 0 = turn off
-  bool executed;
-  bool valid;       // true if schedule slot is populated
+// Schedule table. Capacity is fixed at build time (SCHEDULE_CAPACITY);
+// ids run from 0 to SCHEDULE_CAPACITY - 1.
+#ifndef SCHEDULE_CAPACITY
+#define SCHEDULE_CAPACITY 256
+#endif
+#ifndef SCHEDULE_RULE_CAPACITY
+#define SCHEDULE_RULE_CAPACITY 64  // schedules with a date range or repeat interval
+#endif
+
+// Packed schedule entry, 4 bytes:
+//   bits 0-10  minute of day (0-1439), first occurrence for repeating schedules
+//   bit  11    switch state (1 = turn on, 0 = turn off)
+//   bit  12    valid (slot populated)
+//   bits 13-19 weekday mask, bit 0 = Sunday; 0 = every day
+//   bits 20-27 rule slot + 1 in scheduleRules[], 0 = none
+typedef uint32_t ScheduleEntry;
+const uint32_t SCHED_MINUTE_MASK = 0x7FF;
+const uint32_t SCHED_SWITCH_BIT  = 1UL << 11;
+const uint32_t SCHED_VALID_BIT   = 1UL << 12;
+const int SCHED_DAYS_SHIFT = 13;
+const uint32_t SCHED_DAYS_MASK   = 0x7FUL << SCHED_DAYS_SHIFT;
+const int SCHED_RULE_SHIFT = 20;
+const uint32_t SCHED_RULE_MASK   = 0xFFUL << SCHED_RULE_SHIFT;
+
+const uint16_t SCHEDULE_OPEN_END = 0xFFFF;
+
+// Optional part of a schedule, kept out of the 4-byte entry
+struct ScheduleRule {
+  uint16_t firstDay;     // local days since 1970-01-01, inclusive
+  uint16_t lastDay;      // inclusive, 0xFFFF = open-ended
+  uint16_t interval;     // repeat every N minutes, 0 = fire once at the start minute
+  uint16_t untilMinute;  // last minute of day a repeat may fire at
 };
 
-Schedule schedules[16];
+ScheduleEntry schedules[SCHEDULE_CAPACITY];
+uint16_t scheduleOrder[SCHEDULE_CAPACITY];  // ids of valid schedules, sorted by minute of day, then id
+int scheduleCount = 0;
+ScheduleRule scheduleRules[SCHEDULE_RULE_CAPACITY];
+int16_t scheduleRuleOwner[SCHEDULE_RULE_CAPACITY];  // owning schedule id, -1 = free
+uint16_t scheduleRepeating[SCHEDULE_RULE_CAPACITY]; // ids of schedules with an interval
+int scheduleRepeatCount = 0;
+volatile bool scheduleWake = false;  // set by the schedule timer and time sync
+
+const int STATUS_MAX_SCHEDULES = 16;      // upcoming schedules listed in /status
 Preferences preferences;
 
-// Journal (in-memory log)
-const int JOURNAL_MAX_LINES = 300;
-String journal[JOURNAL_MAX_LINES];
+// Journal (in-memory log, fixed-size byte ring)
+#ifndef JOURNAL_ARENA_KB
+#define JOURNAL_ARENA_KB 16
+#endif
+#ifndef JOURNAL_PERSIST_KB
+#define JOURNAL_PERSIST_KB 128  // flash budget for journal segments
+#endif
+const size_t JOURNAL_ARENA_SIZE = JOURNAL_ARENA_KB * 1024;
+const size_t JOURNAL_RECORD_HEADER = 2;  // 16-bit little-endian length prefix
+const size_t JOURNAL_MAX_LINE = 128;     // longest rendered entry, timestamp included
+const size_t JOURNAL_STREAM_CHUNK = 512; // GET /journal send buffer
+const time_t MIN_VALID_EPOCH = 1577836800;  // 2020-01-01, anything earlier means "not synced"
+
+enum JournalEvent : uint8_t {
+  EV_MANUAL_REQUEST,    // a0 = desired state
+  EV_MANUAL_RESULT,     // a0 = desired state, a1 = ActuationResult, a2 = attempts
+  EV_MANUAL_DROPPED,    // a0 = desired state (no longer written, kept for old records)
+  EV_SCHEDULE_TRIGGER,  // a0 = schedule id, a1 = desired state
+  EV_SCHEDULE_RESULT,   // a0 = schedule id, a1 = ActuationResult, a2 = attempts
+  EV_SCHEDULE_DROPPED   // a0 = schedule id (no longer written, kept for old records)
+};
+
+enum ActuationResult {
+  RESULT_ALREADY_THERE,
+  RESULT_SUCCESS,
+  RESULT_FAILED,
+  RESULT_SUPERSEDED
+};
+
+// Binary journal entry, 15 bytes; rendered to text only when read
+struct __attribute__((packed)) JournalRecord {
+  uint32_t epoch;  // 0 = clock not synced
+  uint32_t seq;
+  uint8_t type;    // JournalEvent
+  int16_t args[3];
+};
+
+uint8_t journalArena[JOURNAL_ARENA_SIZE];
+size_t journalHead = 0;  // offset of the oldest record
+size_t journalUsed = 0;  // bytes occupied by records
 int journalCount = 0;
-int journalIndex = 0;  // Circular buffer index
+uint32_t journalNextSeq = 1;
+
+struct JournalIterator {
+  size_t offset;
+  size_t remaining;
+};
 
 const char* WIFI_SSID     = "imenilenina-bistro";
 const char* WIFI_PASSWORD = "10101010";
@@ -59,405 +151,2906 @@ WebServer server(HTTP_PORT);
 //
 //curl -X PUT "http://192.168.4.120/schedule?id=1&hour=7&minute=0&switch=0"
 
-bool isAcOn() {
-  for (int i = 0; i < 5; i++) {
+// ========== Serial Logger ==========
+//
+// Serial output goes through a lock-free single-producer/single-consumer byte
+// queue drained by a low-priority logger task, so callers never wait on the
+// UART. All producers run in the loop task. When the queue is full the line
+// is dropped and counted (reported in /status).
+
+const size_t LOG_QUEUE_SIZE = 2048;  // power of two
+const size_t LOG_MAX_LINE = 160;
+
+char logQueue[LOG_QUEUE_SIZE];
+uint32_t logQueueHead = 0;  // advanced by the logger task only
+uint32_t logQueueTail = 0;  // advanced by the producer only
+volatile uint32_t logDropped = 0;
+TaskHandle_t loggerTask = nullptr;
+
+void logWrite(const char* data, size_t len) {
+  uint32_t tail = logQueueTail;
+  uint32_t head = __atomic_load_n(&logQueueHead, __ATOMIC_ACQUIRE);
+  if (LOG_QUEUE_SIZE - (tail - head) < len) {
+    logDropped++;
+    return;
+  }
+
+  size_t offset = tail & (LOG_QUEUE_SIZE - 1);
+  size_t first = LOG_QUEUE_SIZE - offset;
+  if (first > len) first = len;
+  memcpy(logQueue + offset, data, first);
+  memcpy(logQueue, data + first, len - first);
+  __atomic_store_n(&logQueueTail, tail + len, __ATOMIC_RELEASE);
+
+  if (loggerTask) xTaskNotifyGive(loggerTask);
+}
+
+void logPrintf(const char* format, ...) {
+  char line[LOG_MAX_LINE];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len <= 0) return;
+  logWrite(line, (size_t)len < sizeof(line) ? len : sizeof(line) - 1);
+}
+
+void loggerTaskMain(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t head = logQueueHead;
+    uint32_t tail = __atomic_load_n(&logQueueTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      size_t offset = head & (LOG_QUEUE_SIZE - 1);
+      size_t len = tail - head;
+      if (len > LOG_QUEUE_SIZE - offset) len = LOG_QUEUE_SIZE - offset;
+      Serial.write((const uint8_t*)logQueue + offset, len);
+      head += len;
+      __atomic_store_n(&logQueueHead, head, __ATOMIC_RELEASE);
+      tail = __atomic_load_n(&logQueueTail, __ATOMIC_ACQUIRE);
+    }
+  }
+}
+
+// Compile-time log levels: statements above AC_LOG_LEVEL (set in
+// platformio.ini) expand to nothing, arguments and string literals included.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef AC_LOG_LEVEL
+#define AC_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_DISCARD(...) do {} while (0)
+
+#if AC_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logPrintf(__VA_ARGS__)
+#else
+#define LOG_ERROR LOG_DISCARD
+#endif
+
+#if AC_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logPrintf(__VA_ARGS__)
+#else
+#define LOG_WARN LOG_DISCARD
+#endif
+
+#if AC_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logPrintf(__VA_ARGS__)
+#else
+#define LOG_INFO LOG_DISCARD
+#endif
+
+#if AC_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logPrintf(__VA_ARGS__)
+#else
+#define LOG_DEBUG LOG_DISCARD
+#endif
+
+void initLogger() {
+  xTaskCreate(loggerTaskMain, "logger", 2048, nullptr, tskIDLE_PRIORITY + 1, &loggerTask);
+}
+
+// ========== Loop Wake-ups ==========
+//
+// loop() sleeps on its task notification instead of a fixed delay(). It is
+// woken by
+//   - the network watcher task, when the listening socket or the client
+//     WebServer is serving becomes readable (WAKE_NET)
+//   - the schedule timer and time sync (WAKE_SCHEDULE)
+//   - the LED interrupt (WAKE_LED; see LED Sense for when it wakes)
+//   - the actuator task, when a job finishes (WAKE_JOB)
+//   - state version bumps (WAKE_STATE), so long-poll waiters are answered
+// and otherwise by the earliest deadline a tick function registered with
+// wakeLoopAt(), or after LOOP_MAX_SLEEP_MS as a backstop for missed edges
+// and parked clients that went away.
+//
+// server.handleClient() only runs on WAKE_NET. The watcher selects on the
+// socket WebServer would look at next, then waits for loop() to hand it
+// the (possibly new) client socket before selecting again, so the set it
+// watches never changes under it.
+
+const unsigned long LOOP_MAX_SLEEP_MS = 1000;
+const unsigned long LOOP_RATE_WINDOW_MS = 10000;
+const unsigned long NET_CLIENT_POLL_MS = 500;   // lets WebServer time out a silent client
+const unsigned long NET_FALLBACK_POLL_MS = 20;  // no listening socket found: the old loop period
+
+const uint32_t WAKE_NET = 1 << 0;
+const uint32_t WAKE_SCHEDULE = 1 << 1;
+const uint32_t WAKE_LED = 1 << 2;
+const uint32_t WAKE_JOB = 1 << 3;
+const uint32_t WAKE_STATE = 1 << 4;
+
+TaskHandle_t loopTask = nullptr;
+TaskHandle_t netWatcherTask = nullptr;
+int netListenFd = -1;
+volatile int netClientFd = -1;
+
+unsigned long loopSleepMs = 0;  // this pass's sleep, lowered by wakeLoopAt()
+uint32_t loopWakeCount = 0;
+unsigned long loopRateWindowMs = 0;
+uint32_t loopWakeupsPerSec = 0;  // over the last full window, shown in /status
+
+void wakeLoop(uint32_t reason) {
+  if (loopTask) xTaskNotify(loopTask, reason, eSetBits);
+}
+
+void IRAM_ATTR wakeLoopFromISR(uint32_t reason) {
+  if (!loopTask) return;
+  BaseType_t higherPriorityWoken = pdFALSE;
+  xTaskNotifyFromISR(loopTask, reason, eSetBits, &higherPriorityWoken);
+  if (higherPriorityWoken) portYIELD_FROM_ISR();
+}
+
+// Called from loop() by ticks with timed work: the next pass runs no later than dueMs
+void wakeLoopAt(unsigned long dueMs) {
+  long wait = (long)(dueMs - millis());
+  if (wait < 0) wait = 0;
+  if ((unsigned long)wait < loopSleepMs) loopSleepMs = wait;
+}
+
+// Blocks until a wake-up or the registered deadline; returns the WAKE_* bits
+uint32_t waitForLoopWake() {
+  uint32_t reasons = 0;
+  xTaskNotifyWait(0, UINT32_MAX, &reasons, pdMS_TO_TICKS(loopSleepMs));
+  loopSleepMs = LOOP_MAX_SLEEP_MS;
+
+  loopWakeCount++;
+  unsigned long now = millis();
+  if (now - loopRateWindowMs >= LOOP_RATE_WINDOW_MS) {
+    loopWakeupsPerSec = (loopWakeCount * 1000UL + (now - loopRateWindowMs) / 2) / (now - loopRateWindowMs);
+    loopWakeCount = 0;
+    loopRateWindowMs = now;
+  }
+  return reasons;
+}
+
+// WiFiServer does not expose its socket, so look it up among the lwIP sockets
+int findListeningSocket(uint16_t port) {
+  for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+    int listening = 0;
+    socklen_t len = sizeof(listening);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) != 0 || !listening) continue;
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr*)&addr, &addrLen) == 0 && ntohs(addr.sin_port) == port) {
+      return fd;
+    }
+  }
+  return -1;
+}
+
+void netWatcherMain(void*) {
+  for (;;) {
+    // WebServer serves one client at a time and only accepts when idle
+    int fd = netClientFd >= 0 ? netClientFd : netListenFd;
+    if (fd < 0) {
+      vTaskDelay(pdMS_TO_TICKS(NET_FALLBACK_POLL_MS));
+    } else {
+      fd_set readable;
+      FD_ZERO(&readable);
+      FD_SET(fd, &readable);
+      struct timeval timeout = { 0, (long)NET_CLIENT_POLL_MS * 1000 };
+      if (select(fd + 1, &readable, nullptr, nullptr, netClientFd >= 0 ? &timeout : nullptr) < 0) {
+        vTaskDelay(pdMS_TO_TICKS(NET_FALLBACK_POLL_MS));  // don't spin on a persistent error
+      }
+    }
+    wakeLoop(WAKE_NET);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // until loop() has run handleClient()
+  }
+}
+
+// Called from loop() after server.handleClient()
+void rearmNetWatcher() {
+  netClientFd = server.client().fd();
+  xTaskNotifyGive(netWatcherTask);
+}
+
+// After server.begin()
+void initNetWatcher() {
+  server.enableDelay(false);
+  netListenFd = findListeningSocket(HTTP_PORT);
+  if (netListenFd < 0) {
+    LOG_WARN("[HTTP] Listening socket not found, polling every %lu ms\n", NET_FALLBACK_POLL_MS);
+  }
+  xTaskCreate(netWatcherMain, "netwatch", 2048, nullptr, tskIDLE_PRIORITY + 1, &netWatcherTask);
+}
+
+// ========== LED Sense ==========
+//
+// The LED line is watched by an edge interrupt instead of being polled.
+// The AC counts as ON as soon as the line is seen LOW and as OFF only after
+// it has stayed HIGH for LED_OFF_HOLD_MS, the same window the old 5-sample
+// poll covered. State and transition time share one 32-bit word so readers
+// get a consistent snapshot from a single load.
+//
+// The interrupt wakes loop() when the state turns ON, and on the first
+// edge while ON that loop() is not already watching for OFF. From then on
+// ledSenseTick() keeps an OFF-hold deadline until the line is seen
+// steadily LOW, so a pulsed line costs one loop() pass per hold period
+// rather than one per edge, and a steady one none at all.
+// The actuator task applies the same hold itself through ledSenseUpdate()
+// while it waits on a press, so it never depends on loop() to see OFF.
+
+const unsigned long LED_OFF_HOLD_MS = 25;
+const uint32_t LED_STATE_BIT = 0x80000000UL;
+
+volatile uint32_t ledSenseWord = 0;       // bit 31 = AC on, bits 0-30 = millis() of last transition
+volatile unsigned long ledLastLowMs = 0;  // last instant the line was LOW
+volatile uint32_t ledEdgeCount = 0;
+volatile bool ledOffWatch = false;        // loop() has an OFF-hold deadline
+uint32_t ledTickEdgeCount = 0;            // ledEdgeCount as of the last ledSenseTick()
+portMUX_TYPE ledSenseMux = portMUX_INITIALIZER_UNLOCKED;
+
+inline uint32_t packLedSense(bool on, unsigned long ms) {
+  return (on ? LED_STATE_BIT : 0) | (ms & ~LED_STATE_BIT);
+}
+
+void IRAM_ATTR onLedSenseEdge() {
+  portENTER_CRITICAL_ISR(&ledSenseMux);
+  unsigned long now = millis();
+  // Either edge means the line was LOW right up to (or from) this instant
+  ledLastLowMs = now;
+  ledEdgeCount++;
+  bool wake = false;
+  if (!(ledSenseWord & LED_STATE_BIT)) {
     if (digitalRead(LED_SENSE_PIN) == LOW) {
+      ledSenseWord = packLedSense(true, now);
+      wake = true;
+    }
+  } else if (!ledOffWatch) {
+    ledOffWatch = true;
+    wake = true;
+  }
+  portEXIT_CRITICAL_ISR(&ledSenseMux);
+
+  if (wake) wakeLoopFromISR(WAKE_LED);
+}
+
+// Applies the OFF hold time and recovers from a missed edge; returns the
+// state. Caller holds ledSenseMux.
+bool applyLedSenseLocked() {
+  unsigned long now = millis();
+  bool on = ledSenseWord & LED_STATE_BIT;
+  if (digitalRead(LED_SENSE_PIN) == LOW) {
+    ledLastLowMs = now;
+    if (!on) ledSenseWord = packLedSense(true, now);
+  } else if (on && now - ledLastLowMs >= LED_OFF_HOLD_MS) {
+    ledSenseWord = packLedSense(false, ledLastLowMs);
+  }
+  return ledSenseWord & LED_STATE_BIT;
+}
+
+// Samples the line for a caller outside loop(), the actuator task while it
+// waits on a press. Leaves the OFF watch and loop()'s deadline alone.
+bool ledSenseUpdate() {
+  portENTER_CRITICAL(&ledSenseMux);
+  bool on = applyLedSenseLocked();
+  portEXIT_CRITICAL(&ledSenseMux);
+  return on;
+}
+
+// Called from loop()
+void ledSenseTick() {
+  portENTER_CRITICAL(&ledSenseMux);
+  bool on = applyLedSenseLocked();
+  // Stop watching once ON and LOW with no edges since the last tick; the
+  // next edge re-arms the watch through the interrupt
+  bool steadyLow = ledEdgeCount == ledTickEdgeCount && digitalRead(LED_SENSE_PIN) == LOW;
+  ledTickEdgeCount = ledEdgeCount;
+  ledOffWatch = on && !steadyLow;
+  bool watch = ledOffWatch;
+  unsigned long offDueMs = ledLastLowMs + LED_OFF_HOLD_MS;
+  portEXIT_CRITICAL(&ledSenseMux);
+
+  if (watch) wakeLoopAt(offDueMs);
+}
+
+void initLedSense() {
+  unsigned long now = millis();
+  bool on = digitalRead(LED_SENSE_PIN) == LOW;
+  ledLastLowMs = now;
+  ledSenseWord = packLedSense(on, now);
+  attachInterrupt(digitalPinToInterrupt(LED_SENSE_PIN), onLedSenseEdge, CHANGE);
+}
+
+bool isAcOn() {
+  return ledSenseWord & LED_STATE_BIT;
+}
+
+// millis() of the last debounced transition, truncated to 31 bits
+unsigned long acLastTransitionMs() {
+  return ledSenseWord & ~LED_STATE_BIT;
+}
+
+// ========== JSON Responses ==========
+//
+// Handlers build JSON with JsonWriter (include/JsonWriter.h) in a stack
+// buffer instead of concatenating Strings. ResponseSink sends a body that
+// fits in one buffer as a plain response with Content-Length, and switches
+// to chunked transfer only if the buffer has to be flushed early.
+
+const size_t JSON_BUFFER_SIZE = 512;
+
+class ResponseSink : public JsonSink {
+ public:
+  explicit ResponseSink(int code) : code(code), started(false) {}
+
+  void write(const char* data, size_t len, bool last) override {
+    if (!started && last) {
+      server.send_P(code, "application/json", data, len);
+      return;
+    }
+    if (!started) {
+      server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+      server.send(code, "application/json", "");
+      started = true;
+    }
+    if (len > 0) server.sendContent(data, len);
+    if (last) server.sendContent("");
+  }
+
+ private:
+  int code;
+  bool started;
+};
+
+// {"error":"<message>"}
+void sendJsonError(int code, const char* message) {
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(code);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("error").value(message).endObject().finish();
+}
+
+// {"status":"<status>"}
+void sendJsonStatus(int code, const char* status) {
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(code);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("status").value(status).endObject().finish();
+}
+
+// ========== Event Stream ==========
+//
+// GET /events is a Server-Sent Events stream. Each event is encoded once
+// into a shared byte ring and every subscriber keeps its own read position
+// in it, so fan-out costs one send() per subscriber and no re-formatting.
+// Sends are non-blocking; a subscriber that falls a full ring behind, or
+// makes no progress for EVENT_STALL_MS, is disconnected rather than
+// allowed to hold up loop().
+
+const size_t EVENT_RING_SIZE = 4096;  // power of two
+const int EVENT_MAX_SUBSCRIBERS = 4;
+const size_t EVENT_MAX_LENGTH = 192;
+const unsigned long EVENT_STALL_MS = 5000;
+const unsigned long EVENT_KEEPALIVE_MS = 15000;
+const unsigned long EVENT_RETRY_MS = 20;  // socket buffer full, try again
+
+char eventRing[EVENT_RING_SIZE];
+uint32_t eventWritePos = 0;  // total bytes ever written, ring offset = pos % size
+unsigned long eventLastPublishMs = 0;
+
+struct EventSubscriber {
+  WiFiClient client;
+  uint32_t readPos;
+  unsigned long progressMs;
+  bool active;
+};
+
+EventSubscriber eventSubscribers[EVENT_MAX_SUBSCRIBERS];
+int eventSubscriberCount = 0;
+
+void eventRingWrite(const char* data, size_t len) {
+  size_t offset = eventWritePos % EVENT_RING_SIZE;
+  size_t first = EVENT_RING_SIZE - offset < len ? EVENT_RING_SIZE - offset : len;
+  memcpy(eventRing + offset, data, first);
+  memcpy(eventRing, data + first, len - first);
+  eventWritePos += len;
+  eventLastPublishMs = millis();
+}
+
+// Encodes "event: <type>\n[id: <id>\n]data: <data>\n\n" into the ring. data
+// must be a single line. id 0 omits the id field.
+void publishEvent(const char* type, uint32_t id, const char* data) {
+  if (eventSubscriberCount == 0) return;
+
+  char buf[EVENT_MAX_LENGTH];
+  int len;
+  if (id != 0) {
+    len = snprintf(buf, sizeof(buf), "event: %s\nid: %lu\ndata: %s\n\n", type, (unsigned long)id, data);
+  } else {
+    len = snprintf(buf, sizeof(buf), "event: %s\ndata: %s\n\n", type, data);
+  }
+  if (len <= 0) return;
+  if ((size_t)len >= sizeof(buf)) {
+    // Truncated: keep the terminating blank line
+    len = sizeof(buf) - 1;
+    buf[len - 2] = '\n';
+    buf[len - 1] = '\n';
+  }
+  eventRingWrite(buf, len);
+}
+
+void dropSubscriber(EventSubscriber& sub) {
+  sub.client.stop();
+  sub.client = WiFiClient();
+  sub.active = false;
+  eventSubscriberCount--;
+}
+
+void eventsTick() {
+  if (eventSubscriberCount == 0) return;
+
+  unsigned long now = millis();
+  if (now - eventLastPublishMs >= EVENT_KEEPALIVE_MS) {
+    static const char keepalive[] = ": keepalive\n\n";
+    eventRingWrite(keepalive, sizeof(keepalive) - 1);
+  }
+  wakeLoopAt(eventLastPublishMs + EVENT_KEEPALIVE_MS);
+
+  for (int i = 0; i < EVENT_MAX_SUBSCRIBERS; i++) {
+    EventSubscriber& sub = eventSubscribers[i];
+    if (!sub.active) continue;
+
+    uint32_t pending = eventWritePos - sub.readPos;
+    if (pending > EVENT_RING_SIZE) {
+      LOG_WARN("[EVENTS] Subscriber %d fell behind, dropping\n", i);
+      dropSubscriber(sub);
+      continue;
+    }
+    if (pending == 0) {
+      sub.progressMs = now;
+      if (!sub.client.connected()) dropSubscriber(sub);
+      continue;
+    }
+
+    // Only the contiguous part; the rest goes on the next tick
+    size_t offset = sub.readPos % EVENT_RING_SIZE;
+    size_t len = EVENT_RING_SIZE - offset < pending ? EVENT_RING_SIZE - offset : pending;
+    int sent = send(sub.client.fd(), eventRing + offset, len, MSG_DONTWAIT);
+    if (sent > 0) {
+      sub.readPos += sent;
+      sub.progressMs = now;
+      if (sub.readPos != eventWritePos) wakeLoopAt(now);  // the wrapped part
+    } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      dropSubscriber(sub);
+    } else if (now - sub.progressMs >= EVENT_STALL_MS) {
+      LOG_WARN("[EVENTS] Subscriber %d stalled, dropping\n", i);
+      dropSubscriber(sub);
+    } else {
+      wakeLoopAt(now + EVENT_RETRY_MS);
+    }
+  }
+}
+
+void handleEvents() {
+  int slot = 0;
+  while (slot < EVENT_MAX_SUBSCRIBERS && eventSubscribers[slot].active) slot++;
+  if (slot == EVENT_MAX_SUBSCRIBERS) {
+    sendJsonError(503, "Too many event subscribers");
+    return;
+  }
+
+  // Parked like a long-poll client; the ring takes it from here
+  EventSubscriber& sub = eventSubscribers[slot];
+  sub.client = server.client();
+  sub.client.print("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                   "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n");
+  sub.readPos = eventWritePos;
+  sub.progressMs = millis();
+  sub.active = true;
+  eventSubscriberCount++;
+}
+
+// ========== State Version ==========
+//
+// stateVersion changes whenever something reported by GET /status changes
+// (AC state, schedule table, clock), so clients can wait for a new version
+// instead of polling.
+
+uint32_t stateVersion = 1;
+bool versionedAcOn = false;
+
+void bumpStateVersion() {
+  __atomic_add_fetch(&stateVersion, 1, __ATOMIC_RELEASE);
+  wakeLoop(WAKE_STATE);
+}
+
+uint32_t currentStateVersion() {
+  return __atomic_load_n(&stateVersion, __ATOMIC_ACQUIRE);
+}
+
+void stateVersionTick() {
+  bool on = isAcOn();
+  if (on != versionedAcOn) {
+    versionedAcOn = on;
+    bumpStateVersion();
+    publishEvent("state", 0, on ? "{\"status\":\"1\"}" : "{\"status\":\"0\"}");
+  }
+}
+
+// ========== Journal Functions ==========
+//
+// Entries live in one preallocated byte ring as [len lo][len hi][payload]
+// records. A record may wrap around the end of the arena. When a new entry
+// does not fit, the oldest records are evicted until it does.
+// Payloads are binary JournalRecords; text is only produced when the journal
+// is read.
+
+void journalRingWrite(size_t offset, const uint8_t* data, size_t len) {
+  size_t first = JOURNAL_ARENA_SIZE - offset;
+  if (first > len) first = len;
+  memcpy(journalArena + offset, data, first);
+  memcpy(journalArena, data + first, len - first);
+}
+
+void journalRingRead(size_t offset, uint8_t* data, size_t len) {
+  size_t first = JOURNAL_ARENA_SIZE - offset;
+  if (first > len) first = len;
+  memcpy(data, journalArena + offset, first);
+  memcpy(data + first, journalArena, len - first);
+}
+
+size_t journalRecordLength(size_t offset) {
+  uint8_t hdr[JOURNAL_RECORD_HEADER];
+  journalRingRead(offset, hdr, JOURNAL_RECORD_HEADER);
+  return hdr[0] | (hdr[1] << 8);
+}
+
+void journalEvictOldest() {
+  size_t recordSize = JOURNAL_RECORD_HEADER + journalRecordLength(journalHead);
+  journalHead = (journalHead + recordSize) % JOURNAL_ARENA_SIZE;
+  journalUsed -= recordSize;
+  journalCount--;
+}
+
+void journalAppend(const uint8_t* payload, size_t len) {
+  size_t recordSize = JOURNAL_RECORD_HEADER + len;
+
+  while (JOURNAL_ARENA_SIZE - journalUsed < recordSize) {
+    journalEvictOldest();
+  }
+
+  size_t tail = (journalHead + journalUsed) % JOURNAL_ARENA_SIZE;
+  uint8_t hdr[JOURNAL_RECORD_HEADER] = { (uint8_t)(len & 0xFF), (uint8_t)(len >> 8) };
+  journalRingWrite(tail, hdr, JOURNAL_RECORD_HEADER);
+  journalRingWrite((tail + JOURNAL_RECORD_HEADER) % JOURNAL_ARENA_SIZE, payload, len);
+  journalUsed += recordSize;
+  journalCount++;
+}
+
+JournalIterator journalBegin() {
+  JournalIterator it = { journalHead, journalUsed };
+  return it;
+}
+
+// Copies the next record out of the ring and advances the iterator.
+// Returns false when there are no more entries.
+bool journalNext(JournalIterator& it, JournalRecord& record) {
+  if (it.remaining == 0) return false;
+
+  size_t payloadLen = journalRecordLength(it.offset);
+  size_t payloadOffset = (it.offset + JOURNAL_RECORD_HEADER) % JOURNAL_ARENA_SIZE;
+  memset(&record, 0, sizeof(record));
+  journalRingRead(payloadOffset, (uint8_t*)&record,
+                  payloadLen < sizeof(record) ? payloadLen : sizeof(record));
+
+  size_t recordSize = JOURNAL_RECORD_HEADER + payloadLen;
+  it.offset = (it.offset + recordSize) % JOURNAL_ARENA_SIZE;
+  it.remaining -= recordSize;
+  return true;
+}
+
+const char* onOffName(int state) {
+  return state ? "ON" : "OFF";
+}
+
+void formatActuationResult(int result, int attempts, char* buf, size_t cap) {
+  switch (result) {
+    case RESULT_ALREADY_THERE:
+      snprintf(buf, cap, "Already there");
+      break;
+    case RESULT_SUCCESS:
+      snprintf(buf, cap, "Success from %d retry", attempts);
+      break;
+    case RESULT_SUPERSEDED:
+      snprintf(buf, cap, "Superseded after %d retries", attempts);
+      break;
+    default:
+      snprintf(buf, cap, "Failed after %d retries", attempts);
+      break;
+  }
+}
+
+// Renders the message part of a record (no timestamp)
+int formatJournalMessage(const JournalRecord& record, char* buf, size_t cap) {
+  int a[3] = { record.args[0], record.args[1], record.args[2] };
+  char result[32];
+
+  switch (record.type) {
+    case EV_MANUAL_REQUEST:
+      return snprintf(buf, cap, "Manual turn %s requested", onOffName(a[0]));
+    case EV_MANUAL_RESULT:
+      formatActuationResult(a[1], a[2], result, sizeof(result));
+      return snprintf(buf, cap, "Manual turn %s result: %s", onOffName(a[0]), result);
+    case EV_MANUAL_DROPPED:
+      return snprintf(buf, cap, "Manual turn %s dropped: actuation queue full", onOffName(a[0]));
+    case EV_SCHEDULE_TRIGGER:
+      return snprintf(buf, cap, "Schedule #%d triggered: Turn %s", a[0], onOffName(a[1]));
+    case EV_SCHEDULE_RESULT:
+      formatActuationResult(a[1], a[2], result, sizeof(result));
+      return snprintf(buf, cap, "Schedule #%d result: %s", a[0], result);
+    case EV_SCHEDULE_DROPPED:
+      return snprintf(buf, cap, "Schedule #%d dropped: actuation queue full", a[0]);
+    default:
+      return snprintf(buf, cap, "Unknown event %d (%d, %d, %d)", record.type, a[0], a[1], a[2]);
+  }
+}
+
+// Renders "[YYYY-MM-DD HH:MM:SS] message" into buf, returns its length
+size_t formatJournalRecord(const JournalRecord& record, char* buf, size_t cap) {
+  int pos;
+  if (record.epoch != 0) {
+    time_t t = record.epoch;
+    struct tm timeinfo;
+    localtime_r(&t, &timeinfo);
+    pos = strftime(buf, cap, "[%Y-%m-%d %H:%M:%S] ", &timeinfo);
+  } else {
+    pos = snprintf(buf, cap, "[NO-TIME] ");
+  }
+
+  int msgLen = formatJournalMessage(record, buf + pos, cap - pos);
+  size_t len = pos + (msgLen > 0 ? msgLen : 0);
+  return len < cap ? len : cap - 1;
+}
+
+// ========== Persistent Journal ==========
+//
+// With JOURNAL_PERSIST enabled every record is also staged in RAM and
+// appended to segment files on LittleFS in batches, once enough bytes are
+// pending or the oldest staged record is old enough, to limit flash wear.
+// Segment files use the same [len][payload] framing as the RAM ring and are
+// named after the sequence number of their first record. The oldest segment
+// is deleted when the byte budget is reached. On boot the sequence counter
+// continues from the newest segment, so cursors stay valid across reboots.
+
+#if JOURNAL_PERSIST
+
+const char* JOURNAL_DIR = "/journal";
+const size_t JOURNAL_SEGMENT_BYTES = 8 * 1024;
+const int JOURNAL_MAX_SEGMENTS = JOURNAL_PERSIST_KB * 1024 / JOURNAL_SEGMENT_BYTES;
+const size_t JOURNAL_STAGE_SIZE = 1024;
+const size_t JOURNAL_FLUSH_BYTES = 512;
+const unsigned long JOURNAL_FLUSH_MS = 60000;
+
+bool journalFsReady = false;
+uint32_t journalSegments[JOURNAL_MAX_SEGMENTS];  // first seq of each segment, oldest first
+int journalSegmentCount = 0;
+size_t journalSegmentBytes = 0;  // size of the newest segment
+
+uint8_t journalStage[JOURNAL_STAGE_SIZE];
+size_t journalStageUsed = 0;
+uint32_t journalStageFirstSeq = 0;
+unsigned long journalStageSince = 0;  // millis() when the oldest staged record arrived
+
+struct JournalFileIterator {
+  int segment;  // index into journalSegments
+  File file;
+};
+
+void journalSegmentPath(uint32_t firstSeq, char* path, size_t cap) {
+  snprintf(path, cap, "%s/%08lx.bin", JOURNAL_DIR, (unsigned long)firstSeq);
+}
+
+void journalDropOldestSegment() {
+  char path[32];
+  journalSegmentPath(journalSegments[0], path, sizeof(path));
+  LittleFS.remove(path);
+  journalSegmentCount--;
+  memmove(journalSegments, journalSegments + 1, journalSegmentCount * sizeof(journalSegments[0]));
+}
+
+void journalStartSegment(uint32_t firstSeq) {
+  if (journalSegmentCount >= JOURNAL_MAX_SEGMENTS) {
+    journalDropOldestSegment();
+  }
+  journalSegments[journalSegmentCount++] = firstSeq;
+  journalSegmentBytes = 0;
+}
+
+// Reads one framed record from a segment file. Returns false at end of file
+// or on a truncated record.
+bool journalReadFileRecord(File& file, JournalRecord& record) {
+  uint8_t hdr[JOURNAL_RECORD_HEADER];
+  if (file.read(hdr, JOURNAL_RECORD_HEADER) != JOURNAL_RECORD_HEADER) return false;
+
+  size_t payloadLen = hdr[0] | (hdr[1] << 8);
+  size_t copyLen = payloadLen < sizeof(record) ? payloadLen : sizeof(record);
+  memset(&record, 0, sizeof(record));
+  if (file.read((uint8_t*)&record, copyLen) != copyLen) return false;
+  if (payloadLen > copyLen) {
+    file.seek(payloadLen - copyLen, SeekCur);
+  }
+  return true;
+}
+
+void journalPersistFlush() {
+  if (!journalFsReady || journalStageUsed == 0) return;
+
+  if (journalSegmentCount == 0 || journalSegmentBytes >= JOURNAL_SEGMENT_BYTES) {
+    journalStartSegment(journalStageFirstSeq);
+  }
+
+  char path[32];
+  journalSegmentPath(journalSegments[journalSegmentCount - 1], path, sizeof(path));
+  File file = LittleFS.open(path, FILE_APPEND);
+  if (file) {
+    journalSegmentBytes += file.write(journalStage, journalStageUsed);
+    file.close();
+  } else {
+    LOG_ERROR("[JOURNAL] ERROR: cannot append to segment\n");
+  }
+  journalStageUsed = 0;
+}
+
+void journalPersistStage(const JournalRecord& record) {
+  if (!journalFsReady) return;
+
+  size_t recordSize = JOURNAL_RECORD_HEADER + sizeof(record);
+  if (journalStageUsed + recordSize > JOURNAL_STAGE_SIZE) {
+    journalPersistFlush();
+  }
+  if (journalStageUsed == 0) {
+    journalStageFirstSeq = record.seq;
+    journalStageSince = millis();
+  }
+
+  journalStage[journalStageUsed++] = sizeof(record) & 0xFF;
+  journalStage[journalStageUsed++] = sizeof(record) >> 8;
+  memcpy(journalStage + journalStageUsed, &record, sizeof(record));
+  journalStageUsed += sizeof(record);
+}
+
+// Flushes staged records once the size or age threshold is reached. Called from loop().
+void journalPersistTick() {
+  if (journalStageUsed == 0) return;
+  if (journalStageUsed >= JOURNAL_FLUSH_BYTES || millis() - journalStageSince >= JOURNAL_FLUSH_MS) {
+    journalPersistFlush();
+  } else {
+    wakeLoopAt(journalStageSince + JOURNAL_FLUSH_MS);
+  }
+}
+
+void journalPersistClear() {
+  while (journalSegmentCount > 0) {
+    journalDropOldestSegment();
+  }
+  journalSegmentBytes = 0;
+  journalStageUsed = 0;
+}
+
+void initJournalPersist() {
+  if (!LittleFS.begin(true)) {
+    LOG_ERROR("[JOURNAL] ERROR: LittleFS mount failed, journal is RAM only\n");
+    return;
+  }
+  if (!LittleFS.exists(JOURNAL_DIR)) {
+    LittleFS.mkdir(JOURNAL_DIR);
+  }
+
+  // Collect segment names, kept sorted oldest first
+  File dir = LittleFS.open(JOURNAL_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    const char* name = strrchr(entry.name(), '/');
+    name = name ? name + 1 : entry.name();
+    uint32_t firstSeq = strtoul(name, nullptr, 16);
+    entry.close();
+
+    if (journalSegmentCount >= JOURNAL_MAX_SEGMENTS) {
+      // Over budget (e.g. the budget was lowered): keep the newest segments
+      if (firstSeq < journalSegments[0]) {
+        char path[32];
+        journalSegmentPath(firstSeq, path, sizeof(path));
+        LittleFS.remove(path);
+        entry = dir.openNextFile();
+        continue;
+      }
+      journalDropOldestSegment();
+    }
+    int pos = journalSegmentCount;
+    while (pos > 0 && journalSegments[pos - 1] > firstSeq) {
+      journalSegments[pos] = journalSegments[pos - 1];
+      pos--;
+    }
+    journalSegments[pos] = firstSeq;
+    journalSegmentCount++;
+
+    entry = dir.openNextFile();
+  }
+  dir.close();
+
+  // Continue numbering after the newest persisted record
+  if (journalSegmentCount > 0) {
+    char path[32];
+    journalSegmentPath(journalSegments[journalSegmentCount - 1], path, sizeof(path));
+    File file = LittleFS.open(path, FILE_READ);
+    journalSegmentBytes = file.size();
+    JournalRecord record;
+    while (journalReadFileRecord(file, record)) {
+      journalNextSeq = record.seq + 1;
+    }
+    file.close();
+  }
+
+  journalFsReady = true;
+  LOG_INFO("[JOURNAL] %d segments on flash, next seq %lu\n", journalSegmentCount, (unsigned long)journalNextSeq);
+}
+
+// Positions the iterator on the segment that holds fromSeq
+JournalFileIterator journalPersistBegin(uint32_t fromSeq) {
+  JournalFileIterator it;
+  it.segment = 0;
+  while (it.segment + 1 < journalSegmentCount && journalSegments[it.segment + 1] <= fromSeq) {
+    it.segment++;
+  }
+  if (journalSegmentCount > 0) {
+    char path[32];
+    journalSegmentPath(journalSegments[it.segment], path, sizeof(path));
+    it.file = LittleFS.open(path, FILE_READ);
+  }
+  return it;
+}
+
+// Reads the next persisted record, moving on to newer segments as needed.
+// Staged records that have not been flushed yet are not returned.
+bool journalPersistNext(JournalFileIterator& it, JournalRecord& record) {
+  while (it.segment < journalSegmentCount) {
+    if (it.file && journalReadFileRecord(it.file, record)) {
       return true;
     }
-    delay(5);
+    it.file.close();
+    if (++it.segment < journalSegmentCount) {
+      char path[32];
+      journalSegmentPath(journalSegments[it.segment], path, sizeof(path));
+      it.file = LittleFS.open(path, FILE_READ);
+    }
   }
   return false;
 }
 
-// ========== Journal Functions ==========
+uint32_t journalOldestSeq() {
+  uint32_t ramOldest = journalNextSeq - journalCount;
+  if (journalSegmentCount > 0 && journalSegments[0] < ramOldest) {
+    return journalSegments[0];
+  }
+  return ramOldest;
+}
+
+#else
+
+uint32_t journalOldestSeq() {
+  return journalNextSeq - journalCount;
+}
+
+#endif
+
+void addToJournal(JournalEvent event, int16_t a0 = 0, int16_t a1 = 0, int16_t a2 = 0) {
+  time_t now = time(nullptr);
+
+  JournalRecord record;
+  record.epoch = now >= MIN_VALID_EPOCH ? (uint32_t)now : 0;
+  record.seq = journalNextSeq++;
+  record.type = event;
+  record.args[0] = a0;
+  record.args[1] = a1;
+  record.args[2] = a2;
+  journalAppend((const uint8_t*)&record, sizeof(record));
+#if JOURNAL_PERSIST
+  journalPersistStage(record);
+#endif
+
+  if (eventSubscriberCount > 0) {
+    char line[JOURNAL_MAX_LINE];
+    formatJournalRecord(record, line, sizeof(line));
+    publishEvent("journal", record.seq, line);
+  }
+
+#if AC_LOG_LEVEL >= LOG_LEVEL_DEBUG
+  char message[JOURNAL_MAX_LINE];
+  formatJournalMessage(record, message, sizeof(message));
+  LOG_DEBUG("[JOURNAL] %s\n", message);
+#endif
+}
+
+void clearJournal() {
+  journalHead = 0;
+  journalUsed = 0;
+  journalCount = 0;
+#if JOURNAL_PERSIST
+  journalPersistClear();
+#endif
+  LOG_INFO("[JOURNAL] Cleared\n");
+}
+
+void initGPIO() {
+  pinMode(BUTTON_PIN, OUTPUT);
+  digitalWrite(BUTTON_PIN, LOW); 
+  pinMode(LED_SENSE_PIN, INPUT_PULLUP);
+  initLedSense();
+}
+
+// ========== Button Pulse ==========
+//
+// Presses go through ButtonPulse (include/ButtonPulse.h): the line is
+// raised when the press starts and dropped by a one-shot esp_timer, so the
+// width does not depend on when the actuator task is scheduled, and the
+// task blocks instead of sleeping through it. Completion gives pulseDone,
+// which is what the actuator waits on before it starts verifying.
+
+class EspPulseTimer : public PulseTimer {
+ public:
+  void create(esp_timer_cb_t callback, const char* name) {
+    esp_timer_create_args_t args = {};
+    args.callback = callback;
+    args.name = name;
+    esp_timer_create(&args, &handle);
+  }
+
+  bool arm(uint32_t us) override {
+    return esp_timer_start_once(handle, us) == ESP_OK;
+  }
+
+  bool disarm() override {
+    return esp_timer_stop(handle) == ESP_OK;
+  }
+
+ private:
+  esp_timer_handle_t handle = nullptr;
+};
+
+class ButtonLine : public PulseLine {
+ public:
+  void set(bool high) override {
+    digitalWrite(BUTTON_PIN, high ? HIGH : LOW);
+  }
+};
+
+SemaphoreHandle_t pulseDone = nullptr;
+
+void onButtonPulseDone(void*) {
+  xSemaphoreGive(pulseDone);
+}
+
+EspPulseTimer pulseTimer;
+ButtonLine buttonLine;
+ButtonPulse buttonPulse(pulseTimer, buttonLine, onButtonPulseDone, nullptr);
+
+void onButtonPulseTimer(void*) {
+  buttonPulse.expire();
+}
+
+// Presses the button for widthMs and blocks until the timer has released
+// it. The line is forced low if the timer never fires.
+void pressButton(int widthMs) {
+  xSemaphoreTake(pulseDone, 0);  // drop a stale completion
+  if (!buttonPulse.start(widthMs)) return;
+  if (xSemaphoreTake(pulseDone, pdMS_TO_TICKS(2 * widthMs)) != pdTRUE) {
+    // No logging here, the logger only takes loop() output
+    buttonPulse.abort();
+  }
+}
+
+void initButtonPulse() {
+  pulseDone = xSemaphoreCreateBinary();
+  pulseTimer.create(onButtonPulseTimer, "button");
+}
+
+// ========== Actuator Task ==========
+//
+// A switch request is a press / settle / verify sequence with retries. It
+// runs in its own task, pinned to core 1 (the WiFi and TCP/IP tasks live on
+// core 0), so it can simply sleep between steps while loop() keeps serving
+// HTTP and schedules. Outcomes travel back through a queue that
+// actuationTick() drains into the journal, so the journal, the event stream
+// and the logger keep loop() as their only writer.
+//
+// Requests do not queue up. They go through an intent register that holds
+// only the latest desired state:
+//   - a request for the state already being worked towards joins that job
+//   - a request for the opposite state replaces it; a job that has not
+//     started is superseded at once, a running one stops before its next
+//     press. A press is never cut short: its settle and verify time always
+//     completes, so the next job sees where the thermostat really ended up.
+//
+// Every request is tracked as a job that callers can follow through
+// GET /jobs?id=N. Job ids increase monotonically and a job lives in slot
+// id % JOB_RING_SIZE until it is overwritten JOB_RING_SIZE jobs later.
+// Jobs are only created by loop(); the actuator task only advances the
+// state of the one it is running. That slot can be reused while the job
+// runs (JOB_RING_SIZE alternating requests during one press), so the task
+// writes through updateJob(), which leaves a slot alone once it holds a
+// newer job.
+
+const int ACTUATION_MAX_ATTEMPTS = 5;
+const int ACTUATION_SETTLE_MS = 500;
+const int ACTUATION_EXTRA_WAIT_MS = 1500;
+const int ACTUATION_RESULT_QUEUE_SIZE = 4;
+const BaseType_t ACTUATOR_CORE = 1;
+const UBaseType_t ACTUATOR_PRIORITY = tskIDLE_PRIORITY + 2;  // above loop()
+
+const int JOB_RING_SIZE = 16;
+
+enum JobState : uint8_t {
+  JOB_QUEUED,
+  JOB_PRESSING,    // button held down
+  JOB_VERIFYING,   // released, waiting for the LED
+  JOB_SUCCEEDED,
+  JOB_FAILED,
+  JOB_SUPERSEDED   // replaced by a request for the opposite state
+};
+
+const char* JOB_STATE_NAMES[] = { "queued", "pressing", "verifying", "succeeded", "failed", "superseded" };
+
+struct Job {
+  uint32_t id;  // 0 = empty slot
+  int16_t scheduleId;
+  bool desiredState;
+  volatile uint8_t state;
+  volatile uint8_t retries;
+  uint8_t merged;  // later requests that joined this job
+};
+
+Job jobs[JOB_RING_SIZE];
+uint32_t nextJobId = 1;
+
+struct ActuationRequest {
+  bool desiredState;
+  int scheduleId;  // -1 = manual request
+  uint32_t jobId;
+};
+
+struct ActuationOutcome {
+  ActuationRequest request;
+  ActuationResult result;
+  int attempts;
+};
+
+// The intent register, guarded by intentMux. intent.jobId is the newest
+// unfinished job (0 = none); intentPending is set until the task takes it.
+ActuationRequest intent = { false, -1, 0 };
+bool intentPending = false;
+portMUX_TYPE intentMux = portMUX_INITIALIZER_UNLOCKED;
+
+TaskHandle_t actuatorTask = nullptr;
+QueueHandle_t actuationResults = nullptr;
+
+// Press timing. Each press is timed from the release of the button, where
+// the settle wait starts, until the LED shows the new state. The settle wait
+// is derived from those measurements instead of a fixed constant: the 90th
+// percentile of the last PRESS_SAMPLE_COUNT latencies plus a margin, kept
+// within [PRESS_SETTLE_MIN_MS, PRESS_SETTLE_MAX_MS]. A press that misses it
+// gets an extra wait of twice the settle time, kept within
+// [PRESS_EXTRA_WAIT_MIN_MS, ACTUATION_EXTRA_WAIT_MS], before the next
+// attempt. An EWMA is kept alongside for reporting. Every wait also ends as
+// soon as the LED is where it should be. The samples are saved in NVS after
+// each measured press, so the estimate survives reboots.
+const int PRESS_SETTLE_MIN_MS = 150;
+const int PRESS_SETTLE_MAX_MS = 1000;
+const int PRESS_SETTLE_MARGIN_MS = 100;
+const int PRESS_EXTRA_WAIT_MIN_MS = 300;
+const int PRESS_LATENCY_MAX_MS = 5000;  // longer means the LED change was not ours
+const int PRESS_POLL_MS = 10;
+const int PRESS_SAMPLE_COUNT = 32;
+
+struct PressStats {
+  uint16_t samples[PRESS_SAMPLE_COUNT];  // button release to LED transition, ms
+  uint8_t count;
+  uint8_t next;
+  uint16_t ewmaMs;
+};
+
+PressStats pressStats = {};
+uint16_t pressP90Ms = 0;
+uint16_t pressSettleMs = ACTUATION_SETTLE_MS;  // until there is data
+uint16_t pressExtraWaitMs = ACTUATION_EXTRA_WAIT_MS;
+portMUX_TYPE pressStatsMux = portMUX_INITIALIZER_UNLOCKED;
+Preferences pressPreferences;  // own handle, used from the actuator task
+
+// Recomputes the percentile and settle time from pressStats
+void updatePressTiming() {
+  uint16_t sorted[PRESS_SAMPLE_COUNT];
+  int n = pressStats.count;
+  memcpy(sorted, pressStats.samples, n * sizeof(uint16_t));
+  for (int i = 1; i < n; i++) {
+    uint16_t v = sorted[i];
+    int j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  uint16_t p90 = n > 0 ? sorted[(n * 9) / 10 < n ? (n * 9) / 10 : n - 1] : 0;
+
+  int settle = n > 0 ? p90 + PRESS_SETTLE_MARGIN_MS : ACTUATION_SETTLE_MS;
+  if (settle < PRESS_SETTLE_MIN_MS) settle = PRESS_SETTLE_MIN_MS;
+  if (settle > PRESS_SETTLE_MAX_MS) settle = PRESS_SETTLE_MAX_MS;
+
+  int extra = n > 0 ? 2 * settle : ACTUATION_EXTRA_WAIT_MS;
+  if (extra < PRESS_EXTRA_WAIT_MIN_MS) extra = PRESS_EXTRA_WAIT_MIN_MS;
+  if (extra > ACTUATION_EXTRA_WAIT_MS) extra = ACTUATION_EXTRA_WAIT_MS;
+
+  portENTER_CRITICAL(&pressStatsMux);
+  pressP90Ms = p90;
+  pressSettleMs = settle;
+  pressExtraWaitMs = extra;
+  portEXIT_CRITICAL(&pressStatsMux);
+}
+
+void recordPressLatency(unsigned long latencyMs) {
+  portENTER_CRITICAL(&pressStatsMux);
+  pressStats.samples[pressStats.next] = latencyMs;
+  pressStats.next = (pressStats.next + 1) % PRESS_SAMPLE_COUNT;
+  if (pressStats.count < PRESS_SAMPLE_COUNT) pressStats.count++;
+  if (pressStats.count == 1) {
+    pressStats.ewmaMs = latencyMs;
+  } else {
+    pressStats.ewmaMs += ((long)latencyMs - (long)pressStats.ewmaMs) / 8;
+  }
+  portEXIT_CRITICAL(&pressStatsMux);
+
+  updatePressTiming();
+  bumpStateVersion();  // shown in /status
+
+  pressPreferences.begin("actuator", false);
+  pressPreferences.putBytes("press", &pressStats, sizeof(pressStats));
+  pressPreferences.end();
+}
+
+void loadPressStats() {
+  pressPreferences.begin("actuator", true);
+  if (pressPreferences.getBytesLength("press") == sizeof(pressStats)) {
+    pressPreferences.getBytes("press", &pressStats, sizeof(pressStats));
+    if (pressStats.count > PRESS_SAMPLE_COUNT || pressStats.next >= PRESS_SAMPLE_COUNT) {
+      pressStats = PressStats();
+    }
+  }
+  pressPreferences.end();
+  updatePressTiming();
+  LOG_INFO("[ACT] Press latency: %u samples, settle %u ms\n", pressStats.count, pressSettleMs);
+}
+
+// Waits up to timeoutMs for the LED to show desiredState; true if it did.
+// Samples the line itself, so OFF is seen even while loop() is busy.
+bool waitForLed(bool desiredState, int timeoutMs) {
+  unsigned long start = millis();
+  for (;;) {
+    unsigned long elapsed = millis() - start;
+    if (ledSenseUpdate() == desiredState) return true;
+    if (elapsed >= (unsigned long)timeoutMs) return false;
+    vTaskDelay(pdMS_TO_TICKS(PRESS_POLL_MS));
+  }
+}
+
+Job* findJob(uint32_t id) {
+  if (id == 0) return nullptr;
+  Job& job = jobs[id % JOB_RING_SIZE];
+  return job.id == id ? &job : nullptr;
+}
+
+// Sets the state of job id unless its slot was reused. Slots are filled
+// under intentMux, so the id check and the write cannot interleave with
+// setOn().
+void updateJob(uint32_t id, JobState state, int retries) {
+  portENTER_CRITICAL(&intentMux);
+  Job& job = jobs[id % JOB_RING_SIZE];
+  if (job.id == id) {
+    job.state = state;
+    job.retries = retries;
+  }
+  portEXIT_CRITICAL(&intentMux);
+}
+
+bool isIntentCurrent(uint32_t jobId) {
+  portENTER_CRITICAL(&intentMux);
+  bool current = intent.jobId == jobId;
+  portEXIT_CRITICAL(&intentMux);
+  return current;
+}
+
+bool takeIntent(ActuationRequest& request) {
+  portENTER_CRITICAL(&intentMux);
+  bool pending = intentPending;
+  if (pending) {
+    request = intent;
+    intentPending = false;
+  }
+  portEXIT_CRITICAL(&intentMux);
+  return pending;
+}
+
+void finishIntent(uint32_t jobId) {
+  portENTER_CRITICAL(&intentMux);
+  if (intent.jobId == jobId) intent.jobId = 0;
+  portEXIT_CRITICAL(&intentMux);
+}
+
+ActuationResult runActuation(const ActuationRequest& request, int& attempts) {
+  attempts = 0;
+  for (;;) {
+    if (ledSenseUpdate() == request.desiredState) {
+      return attempts == 0 ? RESULT_ALREADY_THERE : RESULT_SUCCESS;
+    }
+    if (!isIntentCurrent(request.jobId)) {
+      return RESULT_SUPERSEDED;
+    }
+    if (attempts >= ACTUATION_MAX_ATTEMPTS) {
+      return RESULT_FAILED;
+    }
+
+    portENTER_CRITICAL(&pressStatsMux);
+    int settleMs = pressSettleMs;
+    int extraWaitMs = pressExtraWaitMs;
+    portEXIT_CRITICAL(&pressStatsMux);
+
+    updateJob(request.jobId, JOB_PRESSING, attempts);
+    unsigned long pressStart = millis();
+    pressButton(BUTTON_PRESS_DURATION);
+    unsigned long pulseMs = millis() - pressStart;
+    updateJob(request.jobId, JOB_VERIFYING, attempts);
+    // LED not there after the learned settle time, give the thermostat more
+    bool reached = waitForLed(request.desiredState, settleMs) ||
+                   waitForLed(request.desiredState, extraWaitMs);
+    attempts++;
+
+    if (reached) {
+      // Measured from the release; 0 if the LED changed while held
+      unsigned long sincePress = (acLastTransitionMs() - pressStart) & ~LED_STATE_BIT;
+      unsigned long latency = sincePress > pulseMs ? sincePress - pulseMs : 0;
+      if (latency <= PRESS_LATENCY_MAX_MS) recordPressLatency(latency);
+    }
+  }
+}
+
+JobState jobStateFor(ActuationResult result) {
+  switch (result) {
+    case RESULT_ALREADY_THERE:
+    case RESULT_SUCCESS:
+      return JOB_SUCCEEDED;
+    case RESULT_SUPERSEDED:
+      return JOB_SUPERSEDED;
+    default:
+      return JOB_FAILED;
+  }
+}
+
+void actuatorTaskMain(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    ActuationRequest request;
+    while (takeIntent(request)) {
+      ActuationOutcome outcome;
+      outcome.request = request;
+      outcome.result = runActuation(request, outcome.attempts);
+      updateJob(request.jobId, jobStateFor(outcome.result), outcome.attempts);
+      finishIntent(request.jobId);
+      xQueueSend(actuationResults, &outcome, portMAX_DELAY);
+      wakeLoop(WAKE_JOB);
+    }
+  }
+}
+
+void journalActuationResult(const ActuationRequest& req, ActuationResult result, int attempts) {
+  if (req.scheduleId >= 0) {
+    addToJournal(EV_SCHEDULE_RESULT, req.scheduleId, result, attempts);
+  } else {
+    addToJournal(EV_MANUAL_RESULT, req.desiredState, result, attempts);
+  }
+}
+
+// Records desiredState as the latest intent; the outcome is written to the
+// journal. Returns the id of the job that will carry it out, which is an
+// existing one if it already aims for the same state.
+uint32_t setOn(bool desiredState, int scheduleId) {
+  portENTER_CRITICAL(&intentMux);
+  if (intent.jobId != 0 && intent.desiredState == desiredState) {
+    uint32_t joined = intent.jobId;
+    portEXIT_CRITICAL(&intentMux);
+    Job& job = jobs[joined % JOB_RING_SIZE];
+    if (job.merged < UINT8_MAX) job.merged++;
+    return joined;
+  }
+
+  uint32_t id = nextJobId;
+  nextJobId = nextJobId == UINT32_MAX ? 1 : nextJobId + 1;
+
+  // The slot is filled before the actuator task can see the intent
+  Job& job = jobs[id % JOB_RING_SIZE];
+  job.id = id;
+  job.scheduleId = scheduleId;
+  job.desiredState = desiredState;
+  job.state = JOB_QUEUED;
+  job.retries = 0;
+  job.merged = 0;
+
+  ActuationRequest replaced = intent;
+  bool replacedPending = intentPending && replaced.jobId != 0;
+  intent.desiredState = desiredState;
+  intent.scheduleId = scheduleId;
+  intent.jobId = id;
+  intentPending = true;
+  portEXIT_CRITICAL(&intentMux);
+
+  // Never started, so it is finished here rather than by the task
+  if (replacedPending) {
+    updateJob(replaced.jobId, JOB_SUPERSEDED, 0);
+    journalActuationResult(replaced, RESULT_SUPERSEDED, 0);
+  }
+
+  xTaskNotifyGive(actuatorTask);
+  return id;
+}
+
+// Journals outcomes reported by the actuator task; called from loop()
+void actuationTick() {
+  ActuationOutcome outcome;
+  while (xQueueReceive(actuationResults, &outcome, 0) == pdTRUE) {
+    journalActuationResult(outcome.request, outcome.result, outcome.attempts);
+  }
+}
+
+void initActuator() {
+  initButtonPulse();
+  loadPressStats();
+  actuationResults = xQueueCreate(ACTUATION_RESULT_QUEUE_SIZE, sizeof(ActuationOutcome));
+  xTaskCreatePinnedToCore(actuatorTaskMain, "actuator", 3072, nullptr,
+                          ACTUATOR_PRIORITY, &actuatorTask, ACTUATOR_CORE);
+}
+
+// ========== Schedule Store ==========
+//
+// schedules[] is indexed by id. scheduleOrder[] lists the populated ids by
+// start minute so the next due entry is found by binary search. Weekday
+// masks are stored in the entry itself; date ranges and repeat intervals
+// live in a small rule pool and repeating schedules are also listed in
+// scheduleRepeating[], since their later occurrences are not in the index.
+
+const char* WEEKDAY_NAMES[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+inline bool isScheduleId(int id) {
+  return id >= 0 && id < SCHEDULE_CAPACITY;
+}
+
+inline ScheduleEntry packSchedule(int hour, int minute, int switchState, int weekdays = 0) {
+  return (uint32_t)(hour * 60 + minute) | (switchState ? SCHED_SWITCH_BIT : 0) | SCHED_VALID_BIT |
+         ((uint32_t)weekdays << SCHED_DAYS_SHIFT);
+}
+
+inline int scheduleMinuteOfDay(ScheduleEntry entry) {
+  return entry & SCHED_MINUTE_MASK;
+}
+
+inline int scheduleHour(ScheduleEntry entry) {
+  return scheduleMinuteOfDay(entry) / 60;
+}
+
+inline int scheduleMinuteOfHour(ScheduleEntry entry) {
+  return scheduleMinuteOfDay(entry) % 60;
+}
+
+inline int scheduleSwitch(ScheduleEntry entry) {
+  return (entry & SCHED_SWITCH_BIT) ? 1 : 0;
+}
+
+inline int scheduleWeekdays(ScheduleEntry entry) {
+  return (entry & SCHED_DAYS_MASK) >> SCHED_DAYS_SHIFT;
+}
+
+// Index into scheduleRules[], or -1 if the schedule has no rule
+inline int scheduleRuleSlot(ScheduleEntry entry) {
+  return (int)((entry & SCHED_RULE_MASK) >> SCHED_RULE_SHIFT) - 1;
+}
+
+bool isScheduleValid(int id) {
+  return isScheduleId(id) && (schedules[id] & SCHED_VALID_BIT);
+}
+
+const ScheduleRule* scheduleRule(int id) {
+  int slot = scheduleRuleSlot(schedules[id]);
+  return slot >= 0 ? &scheduleRules[slot] : nullptr;
+}
+
+// Local days since 1970-01-01 for a civil date
+int32_t daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yoe = year - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+void civilFromDays(int32_t days, int& year, int& month, int& day) {
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int32_t doe = days - era * 146097;
+  int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int32_t mp = (5 * doy + 2) / 153;
+  day = doy - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yoe + era * 400 + (month <= 2);
+}
+
+// Whether the schedule is active on the given local day
+bool scheduleRunsOnDay(int id, int32_t day, int weekday) {
+  int weekdays = scheduleWeekdays(schedules[id]);
+  if (weekdays != 0 && !(weekdays & (1 << weekday))) return false;
+
+  const ScheduleRule* rule = scheduleRule(id);
+  return !rule || (day >= rule->firstDay && day <= rule->lastDay);
+}
+
+// First minute >= fromMinute at which a repeating schedule fires within a
+// day, or -1 if its repeats are over for that day
+int scheduleNextRepeat(int id, int fromMinute) {
+  const ScheduleRule* rule = scheduleRule(id);
+  int start = scheduleMinuteOfDay(schedules[id]);
+  if (fromMinute <= start) return start;
+
+  int minute = start + (fromMinute - start + rule->interval - 1) / rule->interval * rule->interval;
+  return minute <= rule->untilMinute ? minute : -1;
+}
+
+// Sort key for scheduleOrder[]: minute of day, ties broken by id
+inline uint32_t scheduleOrderKey(int id) {
+  return ((uint32_t)scheduleMinuteOfDay(schedules[id]) << 16) | id;
+}
+
+// First position in scheduleOrder[] whose key is >= key
+int scheduleLowerBound(uint32_t key) {
+  int lo = 0, hi = scheduleCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (scheduleOrderKey(scheduleOrder[mid]) < key) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// First position whose schedule starts at or after minuteOfDay
+int scheduleFirstAtOrAfter(int minuteOfDay) {
+  return scheduleLowerBound((uint32_t)minuteOfDay << 16);
+}
+
+void clearSchedule(int id) {
+  if (!isScheduleValid(id)) return;
+
+  int pos = scheduleLowerBound(scheduleOrderKey(id));
+  scheduleCount--;
+  memmove(scheduleOrder + pos, scheduleOrder + pos + 1, (scheduleCount - pos) * sizeof(scheduleOrder[0]));
+
+  int slot = scheduleRuleSlot(schedules[id]);
+  if (slot >= 0) {
+    scheduleRuleOwner[slot] = -1;
+    for (int i = 0; i < scheduleRepeatCount; i++) {
+      if (scheduleRepeating[i] == id) {
+        scheduleRepeating[i] = scheduleRepeating[--scheduleRepeatCount];
+        break;
+      }
+    }
+  }
+  schedules[id] = 0;
+}
+
+// Stores a schedule, replacing whatever was in the slot. rule may be null.
+// Returns false, leaving the slot untouched, if the rule pool is full.
+bool setSchedule(int id, ScheduleEntry entry, const ScheduleRule* rule) {
+  int slot = -1;
+  if (rule) {
+    // A slot already owned by this id is released below, so it counts as free
+    slot = 0;
+    while (slot < SCHEDULE_RULE_CAPACITY && scheduleRuleOwner[slot] >= 0 && scheduleRuleOwner[slot] != id) slot++;
+    if (slot == SCHEDULE_RULE_CAPACITY) return false;
+  }
+
+  clearSchedule(id);
+
+  entry &= ~SCHED_RULE_MASK;
+  if (rule) {
+    scheduleRules[slot] = *rule;
+    scheduleRuleOwner[slot] = id;
+    entry |= (uint32_t)(slot + 1) << SCHED_RULE_SHIFT;
+    if (rule->interval > 0) {
+      scheduleRepeating[scheduleRepeatCount++] = id;
+    }
+  }
+  schedules[id] = entry;
+
+  int pos = scheduleLowerBound(scheduleOrderKey(id));
+  memmove(scheduleOrder + pos + 1, scheduleOrder + pos, (scheduleCount - pos) * sizeof(scheduleOrder[0]));
+  scheduleOrder[pos] = id;
+  scheduleCount++;
+  return true;
+}
+
+void initScheduleStore() {
+  for (int slot = 0; slot < SCHEDULE_RULE_CAPACITY; slot++) {
+    scheduleRuleOwner[slot] = -1;
+  }
+}
+
+// ========== NVS Schedule Storage Functions ==========
+//
+// The whole table is one versioned blob under "table", written with a
+// single putBytes() and read back with a single getBytes():
+//   ScheduleBlobHeader
+//   scheduleCount x ScheduleBlobEntry
+//   ruleCount     x ScheduleBlobRule
+// The CRC covers everything after the header. Rule slot numbers inside the
+// entries are not meaningful on disk; rules are matched by id on load.
+//
+// Older firmware stored one key per slot ("sch<id>" + "rul<id>") or, before
+// that, four keys per slot ("sch<id>_v/_h/_m/_s" for ids 0-15). Those are
+// read once, written back as a blob and removed.
+
+const uint32_t SCHEDULE_BLOB_MAGIC = 0x44484353;  // "SCHD"
+const uint16_t SCHEDULE_BLOB_VERSION = 1;
+const char* SCHEDULE_BLOB_KEY = "table";
+const int LEGACY_SCHEDULE_SLOTS = 16;
+
+struct __attribute__((packed)) ScheduleBlobHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t scheduleCount;
+  uint16_t ruleCount;
+  uint32_t crc;
+};
+
+struct __attribute__((packed)) ScheduleBlobEntry {
+  uint16_t id;
+  uint32_t entry;
+};
 
-void addToJournal(String message) {
-  struct tm timeinfo;
-  String timestamp;
+struct __attribute__((packed)) ScheduleBlobRule {
+  uint16_t id;
+  ScheduleRule rule;
+};
 
-  if (getLocalTime(&timeinfo)) {
-    char timeStr[20];
-    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &timeinfo);
-    timestamp = String(timeStr);
-  } else {
-    timestamp = "NO-TIME";
-  }
+const size_t SCHEDULE_BLOB_MAX = sizeof(ScheduleBlobHeader) +
+                                 SCHEDULE_CAPACITY * sizeof(ScheduleBlobEntry) +
+                                 SCHEDULE_RULE_CAPACITY * sizeof(ScheduleBlobRule);
 
-  journal[journalIndex] = "[" + timestamp + "] " + message;
-  journalIndex = (journalIndex + 1) % JOURNAL_MAX_LINES;
+uint8_t scheduleBlob[SCHEDULE_BLOB_MAX];
 
-  if (journalCount < JOURNAL_MAX_LINES) {
-    journalCount++;
+// Serializes the table into scheduleBlob, returns the blob size
+size_t encodeScheduleBlob() {
+  ScheduleBlobHeader header = { SCHEDULE_BLOB_MAGIC, SCHEDULE_BLOB_VERSION, 0, 0, 0 };
+  size_t pos = sizeof(header);
+
+  for (int n = 0; n < scheduleCount; n++) {
+    ScheduleBlobEntry record = { scheduleOrder[n], schedules[scheduleOrder[n]] };
+    memcpy(scheduleBlob + pos, &record, sizeof(record));
+    pos += sizeof(record);
+    header.scheduleCount++;
+  }
+  for (int slot = 0; slot < SCHEDULE_RULE_CAPACITY; slot++) {
+    if (scheduleRuleOwner[slot] < 0) continue;
+    ScheduleBlobRule record = { (uint16_t)scheduleRuleOwner[slot], scheduleRules[slot] };
+    memcpy(scheduleBlob + pos, &record, sizeof(record));
+    pos += sizeof(record);
+    header.ruleCount++;
   }
 
-  Serial.println("[JOURNAL] " + message);
+  header.crc = esp_rom_crc32_le(0, scheduleBlob + sizeof(header), pos - sizeof(header));
+  memcpy(scheduleBlob, &header, sizeof(header));
+  return pos;
 }
 
-void clearJournal() {
-  journalCount = 0;
-  journalIndex = 0;
-  Serial.println("[JOURNAL] Cleared");
+// Loads the table from scheduleBlob; false if the blob is not valid
+bool decodeScheduleBlob(size_t len) {
+  ScheduleBlobHeader header;
+  if (len < sizeof(header)) return false;
+  memcpy(&header, scheduleBlob, sizeof(header));
+
+  size_t expected = sizeof(header) + header.scheduleCount * sizeof(ScheduleBlobEntry) +
+                    header.ruleCount * sizeof(ScheduleBlobRule);
+  if (header.magic != SCHEDULE_BLOB_MAGIC || header.version != SCHEDULE_BLOB_VERSION || expected != len) {
+    return false;
+  }
+  if (esp_rom_crc32_le(0, scheduleBlob + sizeof(header), len - sizeof(header)) != header.crc) {
+    return false;
+  }
+
+  const uint8_t* entries = scheduleBlob + sizeof(header);
+  const uint8_t* rules = entries + header.scheduleCount * sizeof(ScheduleBlobEntry);
+  for (int n = 0; n < header.scheduleCount; n++) {
+    ScheduleBlobEntry record;
+    memcpy(&record, entries + n * sizeof(record), sizeof(record));
+    if (!isScheduleId(record.id) || !(record.entry & SCHED_VALID_BIT)) continue;
+
+    ScheduleBlobRule ruleRecord;
+    ScheduleRule rule;
+    bool hasRule = false;
+    for (int r = 0; r < header.ruleCount && !hasRule; r++) {
+      memcpy(&ruleRecord, rules + r * sizeof(ruleRecord), sizeof(ruleRecord));
+      hasRule = ruleRecord.id == record.id;
+    }
+    if (hasRule) rule = ruleRecord.rule;
+    if (!setSchedule(record.id, record.entry, hasRule ? &rule : nullptr)) {
+      LOG_ERROR("[NVS] ERROR: no rule slot left for schedule %d\n", record.id);
+    }
+  }
+  return true;
 }
 
-void initGPIO() {
-  pinMode(BUTTON_PIN, OUTPUT);
-  digitalWrite(BUTTON_PIN, LOW); 
-  pinMode(LED_SENSE_PIN, INPUT_PULLUP);
-  
+// Reads an original four-key slot; returns 0 if there is none
+ScheduleEntry loadLegacySchedule(int id) {
+  char key[16];
+  snprintf(key, sizeof(key), "sch%d_v", id);
+  if (!preferences.getBool(key, false)) return 0;
+
+  snprintf(key, sizeof(key), "sch%d_h", id);
+  int hour = preferences.getInt(key, 0);
+  snprintf(key, sizeof(key), "sch%d_m", id);
+  int minute = preferences.getInt(key, 0);
+  snprintf(key, sizeof(key), "sch%d_s", id);
+  int switchState = preferences.getInt(key, 0);
+  return packSchedule(hour, minute, switchState);
 }
 
-String setOn(bool desiredState) {
-  const int maxAttempts = 5;
-  for (int attempt = 0; attempt < maxAttempts; attempt++) {
-    if (isAcOn() == desiredState) {
-      return attempt == 0 ? "Already there\n" : "Success from " + String(attempt) + " retry\n";
+// Reads every per-key layout into the table. Returns the number of keys
+// found, so the caller knows whether anything needs removing.
+int loadPerKeySchedules() {
+  int found = 0;
+  char key[16];
+  for (int i = 0; i < SCHEDULE_CAPACITY; i++) {
+    snprintf(key, sizeof(key), "sch%d", i);
+    ScheduleEntry entry = preferences.getUInt(key, 0);
+    if (!(entry & SCHED_VALID_BIT) && i < LEGACY_SCHEDULE_SLOTS) {
+      entry = loadLegacySchedule(i);
     }
-
-    digitalWrite(BUTTON_PIN, HIGH);
-    delay(BUTTON_PRESS_DURATION);
-    digitalWrite(BUTTON_PIN, LOW);
-    delay(500);
-    if (isAcOn() != desiredState) {
-      delay(1500);
+    if (!(entry & SCHED_VALID_BIT)) continue;
+    found++;
+
+    ScheduleRule rule;
+    bool hasRule = false;
+    if (entry & SCHED_RULE_MASK) {
+      snprintf(key, sizeof(key), "rul%d", i);
+      hasRule = preferences.getBytes(key, &rule, sizeof(rule)) == sizeof(rule);
     }
+    setSchedule(i, entry, hasRule ? &rule : nullptr);
   }
-  
-  return "Failed after " + String(maxAttempts) + " retries\n";
+  return found;
 }
 
-// ========== NVS Schedule Storage Functions ==========
+void removePerKeySchedules() {
+  static const char* legacySuffixes[] = { "_v", "_h", "_m", "_s" };
+  char key[16];
+  for (int i = 0; i < SCHEDULE_CAPACITY; i++) {
+    snprintf(key, sizeof(key), "sch%d", i);
+    preferences.remove(key);
+    snprintf(key, sizeof(key), "rul%d", i);
+    preferences.remove(key);
+    for (int k = 0; i < LEGACY_SCHEDULE_SLOTS && k < 4; k++) {
+      snprintf(key, sizeof(key), "sch%d%s", i, legacySuffixes[k]);
+      preferences.remove(key);
+    }
+  }
+}
 
 void loadSchedulesFromNVS() {
   preferences.begin("schedules", false);  // false = read/write mode
   
-  Serial.println("[NVS] Loading schedules from storage...");
-  int loadedCount = 0;
-  
-  for (int i = 0; i < 16; i++) {
-    String keyValid = "sch" + String(i) + "_v";
-    bool isValid = preferences.getBool(keyValid.c_str(), false);
-    
-    if (isValid) {
-      String keyHour = "sch" + String(i) + "_h";
-      String keyMin = "sch" + String(i) + "_m";
-      String keySwitch = "sch" + String(i) + "_s";
-      
-      schedules[i].id = i;
-      schedules[i].hour = preferences.getInt(keyHour.c_str(), 0);
-      schedules[i].minute = preferences.getInt(keyMin.c_str(), 0);
-      schedules[i].switchState = preferences.getInt(keySwitch.c_str(), 0);
-      schedules[i].executed = false;
-      schedules[i].valid = true;
-      
-      loadedCount++;
-      Serial.print("[NVS] Loaded schedule ");
-      Serial.print(i);
-      Serial.print(": ");
-      Serial.print(schedules[i].hour);
-      Serial.print(":");
-      if (schedules[i].minute < 10) Serial.print("0");
-      Serial.print(schedules[i].minute);
-      Serial.print(" switch=");
-      Serial.println(schedules[i].switchState);
-    } else {
-      schedules[i].valid = false;
-      schedules[i].executed = false;
+  LOG_INFO("[NVS] Loading schedules from storage...\n");
+
+  size_t len = preferences.getBytesLength(SCHEDULE_BLOB_KEY);
+  bool loaded = false;
+  if (len > 0 && len <= SCHEDULE_BLOB_MAX) {
+    preferences.getBytes(SCHEDULE_BLOB_KEY, scheduleBlob, len);
+    loaded = decodeScheduleBlob(len);
+    if (!loaded) {
+      LOG_ERROR("[NVS] ERROR: schedule table is corrupt, ignoring it\n");
+    }
+  }
+
+  if (!loaded) {
+    // One-time migration: write the blob first, then drop the old keys. The
+    // blob is written even when there was nothing to migrate, so the
+    // per-key scan does not run again on the next boot.
+    int migrated = loadPerKeySchedules();
+    preferences.putBytes(SCHEDULE_BLOB_KEY, scheduleBlob, encodeScheduleBlob());
+    if (migrated > 0) {
+      removePerKeySchedules();
+      LOG_INFO("[NVS] Migrated %d schedules to a single blob\n", scheduleCount);
     }
   }
+
+#if AC_LOG_LEVEL >= LOG_LEVEL_DEBUG
+  for (int n = 0; n < scheduleCount; n++) {
+    ScheduleEntry entry = schedules[scheduleOrder[n]];
+    LOG_DEBUG("[NVS] Loaded schedule %d: %d:%02d switch=%d\n",
+              scheduleOrder[n], scheduleHour(entry), scheduleMinuteOfHour(entry), scheduleSwitch(entry));
+  }
+#endif
   
-  Serial.print("[NVS] Loaded ");
-  Serial.print(loadedCount);
-  Serial.println(" schedules");
+  LOG_INFO("[NVS] Loaded %d schedules\n", scheduleCount);
   
   preferences.end();
 }
 
-void saveScheduleToNVS(int id) {
-  if (id < 0 || id >= 16) return;
-  
-  preferences.begin("schedules", false);
-  
-  String keyValid = "sch" + String(id) + "_v";
-  String keyHour = "sch" + String(id) + "_h";
-  String keyMin = "sch" + String(id) + "_m";
-  String keySwitch = "sch" + String(id) + "_s";
-  
-  preferences.putBool(keyValid.c_str(), schedules[id].valid);
-  preferences.putInt(keyHour.c_str(), schedules[id].hour);
-  preferences.putInt(keyMin.c_str(), schedules[id].minute);
-  preferences.putInt(keySwitch.c_str(), schedules[id].switchState);
-  
-  Serial.print("[NVS] Saved schedule ");
-  Serial.println(id);
-  
-  preferences.end();
+// scheduleBlob is re-encoded on every edit, not only when saving, so the
+// shutdown handler always finds the current table there. scheduleBlobGen
+// is odd while loop() is rewriting it; the handler may run in another task
+// and uses it to take a consistent copy.
+volatile uint32_t scheduleBlobGen = 0;
+size_t scheduleBlobLength = 0;
+
+void encodeScheduleSnapshot() {
+  __atomic_add_fetch(&scheduleBlobGen, 1, __ATOMIC_SEQ_CST);
+  scheduleBlobLength = encodeScheduleBlob();
+  __atomic_add_fetch(&scheduleBlobGen, 1, __ATOMIC_SEQ_CST);
 }
 
-void deleteScheduleFromNVS(int id) {
-  if (id < 0 || id >= 16) return;
-  
+// Writes the whole table in one NVS operation
+void saveSchedulesToNVS() {
+  encodeScheduleSnapshot();
+  size_t len = scheduleBlobLength;
+
   preferences.begin("schedules", false);
-  
-  String keyValid = "sch" + String(id) + "_v";
-  preferences.putBool(keyValid.c_str(), false);
-  
-  Serial.print("[NVS] Deleted schedule ");
-  Serial.println(id);
-  
+  if (preferences.putBytes(SCHEDULE_BLOB_KEY, scheduleBlob, len) != len) {
+    LOG_ERROR("[NVS] ERROR: failed to save schedule table\n");
+  } else {
+    LOG_DEBUG("[NVS] Saved %d schedules (%u bytes)\n", scheduleCount, (unsigned)len);
+  }
   preferences.end();
-  
-  schedules[id].valid = false;
-  schedules[id].executed = false;
+}
+
+// Edits only change the table in RAM and mark it dirty. The blob is written
+// once edits have been quiet for SCHEDULE_FLUSH_QUIET_MS, on PUT /commit, or
+// from the shutdown handler before esp_restart(), so a burst of PUTs costs a
+// single NVS commit.
+const unsigned long SCHEDULE_FLUSH_QUIET_MS = 3000;
+
+bool scheduleDirty = false;
+unsigned long scheduleDirtyMs = 0;
+
+void markSchedulesDirty() {
+  encodeScheduleSnapshot();
+  scheduleDirty = true;
+  scheduleDirtyMs = millis();
+  bumpStateVersion();
+}
+
+// Returns true if anything was written
+bool flushSchedules() {
+  if (!scheduleDirty) return false;
+  scheduleDirty = false;
+  saveSchedulesToNVS();
+  bumpStateVersion();
+  return true;
+}
+
+void scheduleFlushTick() {
+  if (!scheduleDirty) return;
+  if (millis() - scheduleDirtyMs >= SCHEDULE_FLUSH_QUIET_MS) {
+    flushSchedules();
+  } else {
+    wakeLoopAt(scheduleDirtyMs + SCHEDULE_FLUSH_QUIET_MS);
+  }
+}
+
+const int SHUTDOWN_SNAPSHOT_ATTEMPTS = 5;
+uint8_t shutdownBlob[SCHEDULE_BLOB_MAX];
+
+// Runs in whichever task called esp_restart(), possibly while loop() is
+// editing the table. So it does not log (the logger only takes loop()
+// output) or read the table; it saves a consistent copy of scheduleBlob.
+void onRestartFlushSchedules() {
+  if (!scheduleDirty) return;
+  for (int attempt = 0; attempt < SHUTDOWN_SNAPSHOT_ATTEMPTS; attempt++) {
+    uint32_t gen = __atomic_load_n(&scheduleBlobGen, __ATOMIC_ACQUIRE);
+    if (!(gen & 1)) {
+      size_t len = scheduleBlobLength;
+      memcpy(shutdownBlob, scheduleBlob, len);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&scheduleBlobGen, __ATOMIC_RELAXED) == gen) {
+        Preferences shutdownPreferences;  // preferences may be open in loop()
+        shutdownPreferences.begin("schedules", false);
+        shutdownPreferences.putBytes(SCHEDULE_BLOB_KEY, shutdownBlob, len);
+        shutdownPreferences.end();
+        return;
+      }
+    }
+    vTaskDelay(1);  // loop() is rewriting it
+  }
+}
+
+void initScheduleFlush() {
+  esp_register_shutdown_handler(onRestartFlushSchedules);
 }
 
 // ========== Time Synchronization Functions ==========
 
+// SNTP callback: the wall clock just changed, re-evaluate schedules
+void onTimeSynced(struct timeval*) {
+  scheduleWake = true;
+  wakeLoop(WAKE_SCHEDULE);
+  bumpStateVersion();
+}
+
 void initTime() {
-  Serial.println("[TIME] Initializing NTP time sync...");
+  LOG_INFO("[TIME] Initializing NTP time sync...\n");
   
   // Configure for manual sync only (no automatic re-sync)
   sntp_set_sync_mode(SNTP_SYNC_MODE_IMMED);
+  sntp_set_time_sync_notification_cb(onTimeSynced);
   
   // Configure time with NTP server
   configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
 }
 
 void manualSyncTime() {
-  Serial.println("[TIME] Manual sync requested...");
+  LOG_INFO("[TIME] Manual sync requested...\n");
   sntp_restart();
 }
 
 
 // ========== Schedule Management Functions ==========
+//
+// Instead of scanning the table on every loop() pass, the next minute at
+// which any schedule fires is computed whenever the table or the clock
+// changes, and a one-shot esp_timer is armed for it. checkSchedules() does
+// nothing until that timer (or a time sync) flags a wake-up.
+
+const int MINUTES_PER_DAY = 24 * 60;
+const int SECONDS_PER_DAY = 24 * 3600;
+const int SCHEDULE_LOOKAHEAD_DAYS = 8;  // a full week plus today
+const int64_t SCHEDULE_WAKE_SLACK_US = 50000;  // land safely inside the due minute
+
+esp_timer_handle_t scheduleTimer = nullptr;
+time_t nextScheduleEpoch = 0;   // start of the minute the timer is armed for, 0 = none
+time_t lastScheduleMinute = 0;  // start of the last minute whose schedules were run
+
+void onScheduleTimer(void*) {
+  scheduleWake = true;
+  wakeLoop(WAKE_SCHEDULE);
+}
 
-bool isScheduleValid(int id) {
-  if (id < 0 || id >= 16) return false;
-  return schedules[id].valid;
+int32_t localDayNumber(const struct tm& timeinfo) {
+  return daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
 }
 
-void checkSchedules() {
+// Earliest minute >= fromMinute on the given day at which any schedule
+// fires, or -1 if none does
+int scheduleFirstDueOnDay(int32_t day, int weekday, int fromMinute) {
+  int best = -1;
+  for (int pos = scheduleFirstAtOrAfter(fromMinute); pos < scheduleCount; pos++) {
+    int id = scheduleOrder[pos];
+    if (scheduleRunsOnDay(id, day, weekday)) {
+      best = scheduleMinuteOfDay(schedules[id]);
+      break;
+    }
+  }
+
+  for (int i = 0; i < scheduleRepeatCount; i++) {
+    int id = scheduleRepeating[i];
+    if (!scheduleRunsOnDay(id, day, weekday)) continue;
+    int minute = scheduleNextRepeat(id, fromMinute);
+    if (minute >= 0 && (best < 0 || minute < best)) best = minute;
+  }
+  return best;
+}
+
+// Recomputes the next due minute and re-arms the timer. Call after any
+// change to the schedule table or the clock.
+void rescheduleNextDue() {
+  esp_timer_stop(scheduleTimer);
+  nextScheduleEpoch = 0;
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < MIN_VALID_EPOCH) return;  // armed again on time sync
+  if (scheduleCount == 0) return;
+
   struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
-    return;
+  localtime_r(&tv.tv_sec, &timeinfo);
+  time_t minuteStart = tv.tv_sec - timeinfo.tm_sec;
+  int nowMinute = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+  time_t dayStart = minuteStart - nowMinute * 60;
+  int32_t today = localDayNumber(timeinfo);
+
+  // Skip the current minute if it has already been handled
+  int fromMinute = minuteStart <= lastScheduleMinute ? nowMinute + 1 : nowMinute;
+  int dayOffset = 0;
+  int dueMinute = scheduleFirstDueOnDay(today, timeinfo.tm_wday, fromMinute);
+  while (dueMinute < 0 && ++dayOffset < SCHEDULE_LOOKAHEAD_DAYS) {
+    dueMinute = scheduleFirstDueOnDay(today + dayOffset, (timeinfo.tm_wday + dayOffset) % 7, 0);
   }
+  // Nothing in the window (e.g. a date range starting later): wake up at
+  // the end of it and look again
+  if (dueMinute < 0) dueMinute = 0;
+
+  nextScheduleEpoch = dayStart + (time_t)dayOffset * SECONDS_PER_DAY + dueMinute * 60;
+  int64_t nowUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  int64_t waitUs = (int64_t)nextScheduleEpoch * 1000000 - nowUs + SCHEDULE_WAKE_SLACK_US;
+  esp_timer_start_once(scheduleTimer, waitUs > 0 ? waitUs : 0);
+}
 
-  int currentHour = timeinfo.tm_hour;
-  int currentMinute = timeinfo.tm_min;
+void initScheduleTimer() {
+  esp_timer_create_args_t args = {};
+  args.callback = onScheduleTimer;
+  args.name = "schedule";
+  esp_timer_create(&args, &scheduleTimer);
+  rescheduleNextDue();
+}
 
-  for (int i = 0; i < 16; i++) {
-    if (!schedules[i].valid) continue;
+void fireSchedule(int id) {
+  addToJournal(EV_SCHEDULE_TRIGGER, id, scheduleSwitch(schedules[id]));
 
-    // Check if current time matches schedule
-    if (schedules[i].hour == currentHour &&
-        schedules[i].minute == currentMinute &&
-        !schedules[i].executed) {
+  setOn(scheduleSwitch(schedules[id]) == 1, id);
+}
 
-      schedules[i].executed = true;
+void checkSchedules() {
+  if (!scheduleWake) return;
+  scheduleWake = false;
 
-      String action = (schedules[i].switchState == 1) ? "ON" : "OFF";
-      String logMsg = "Schedule #" + String(i) + " triggered: Turn " + action;
-      addToJournal(logMsg);
+  time_t now = time(nullptr);
+  if (now < MIN_VALID_EPOCH) return;  // woken again on time sync
 
-      String result = setOn(schedules[i].switchState == 1);
-      addToJournal("Schedule #" + String(i) + " result: " + result);
+  struct tm timeinfo;
+  localtime_r(&now, &timeinfo);
+  time_t minuteStart = now - timeinfo.tm_sec;
+  if (minuteStart > lastScheduleMinute) {
+    lastScheduleMinute = minuteStart;
+
+    int nowMinute = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+    int32_t today = localDayNumber(timeinfo);
+
+    for (int pos = scheduleFirstAtOrAfter(nowMinute); pos < scheduleCount; pos++) {
+      int id = scheduleOrder[pos];
+      if (scheduleMinuteOfDay(schedules[id]) != nowMinute) break;
+      if (scheduleRunsOnDay(id, today, timeinfo.tm_wday)) fireSchedule(id);
     }
 
-    // Reset executed flag when minute changes
-    if (schedules[i].minute != currentMinute) {
-      schedules[i].executed = false;
+    // Later repeats; the first occurrence was covered by the index above
+    for (int i = 0; i < scheduleRepeatCount; i++) {
+      int id = scheduleRepeating[i];
+      if (scheduleMinuteOfDay(schedules[id]) == nowMinute) continue;
+      if (!scheduleRunsOnDay(id, today, timeinfo.tm_wday)) continue;
+      if (scheduleNextRepeat(id, nowMinute) == nowMinute) fireSchedule(id);
     }
   }
+
+  rescheduleNextDue();
 }
 
 
-void handleStatus() {
-  bool acOn = isAcOn();
+void writeScheduleJson(JsonWriter& json, int id) {
+  ScheduleEntry entry = schedules[id];
+  json.beginObject()
+      .key("id").value(id)
+      .key("hour").value(scheduleHour(entry))
+      .key("minute").value(scheduleMinuteOfHour(entry))
+      .key("switch").value(scheduleSwitch(entry));
+
+  int weekdays = scheduleWeekdays(entry);
+  if (weekdays != 0) {
+    char days[28];
+    size_t len = 0;
+    for (int d = 0; d < 7; d++) {
+      if (!(weekdays & (1 << d))) continue;
+      if (len > 0) days[len++] = ',';
+      memcpy(days + len, WEEKDAY_NAMES[d], 3);
+      len += 3;
+    }
+    days[len] = '\0';
+    json.key("days").value(days);
+  }
+
+  const ScheduleRule* rule = scheduleRule(id);
+  if (rule) {
+    char buf[16];
+    int year, month, day;
+    if (rule->firstDay > 0) {
+      civilFromDays(rule->firstDay, year, month, day);
+      snprintf(buf, sizeof(buf), "%04d-%02d-%02d", year, month, day);
+      json.key("from").value(buf);
+    }
+    if (rule->lastDay != SCHEDULE_OPEN_END) {
+      civilFromDays(rule->lastDay, year, month, day);
+      snprintf(buf, sizeof(buf), "%04d-%02d-%02d", year, month, day);
+      json.key("to").value(buf);
+    }
+    if (rule->interval > 0) {
+      snprintf(buf, sizeof(buf), "%02d:%02d", rule->untilMinute / 60, rule->untilMinute % 60);
+      json.key("every").value(rule->interval);
+      json.key("until").value(buf);
+    }
+  }
+  json.endObject();
+}
+
+// ========== Status Cache ==========
+//
+// Apart from the clock, the /status body only changes with stateVersion,
+// with the first upcoming schedule (which moves as the day goes by) and with
+// logDropped. Together they form StatusKey; the body is rendered once per
+// key and reused, and only the short status/time prefix is written per
+// request. The same key is the weak ETag, so a matching If-None-Match gets
+// a 304 without touching the body at all.
+
+struct StatusKey {
+  uint32_t version;
+  int firstSchedule;
+  int32_t today;
+  uint32_t dropped;
+};
+
+const size_t STATUS_PREFIX_ROOM = 96;   // {"status":"1","time":"YYYY-MM-DD HH:MM:SS","wakeupsPerSec":N
+const size_t STATUS_BODY_MAX = 2816;   // the rest, with STATUS_MAX_SCHEDULES entries
+const size_t STATUS_ETAG_SIZE = 40;
+
+StatusKey statusCacheKey;
+bool statusCacheValid = false;
+char statusCache[STATUS_PREFIX_ROOM + STATUS_BODY_MAX];
+size_t statusCacheTailLength = 0;  // rendered at statusCache + STATUS_PREFIX_ROOM
+
+// Position in scheduleOrder of the first start at or after the current
+// minute, and today's local day number (0 while the clock is not synced)
+int firstUpcomingSchedule(int32_t& today) {
+  today = 0;
+  time_t now = time(nullptr);
+  if (now < MIN_VALID_EPOCH) return 0;
+  struct tm nowinfo;
+  localtime_r(&now, &nowinfo);
+  today = localDayNumber(nowinfo);
+  return scheduleFirstAtOrAfter(nowinfo.tm_hour * 60 + nowinfo.tm_min);
+}
+
+StatusKey currentStatusKey() {
+  StatusKey key;
+  key.version = currentStateVersion();
+  key.firstSchedule = firstUpcomingSchedule(key.today);
+  key.dropped = logDropped;
+  return key;
+}
+
+bool sameStatusKey(const StatusKey& a, const StatusKey& b) {
+  return a.version == b.version && a.firstSchedule == b.firstSchedule && a.today == b.today &&
+         a.dropped == b.dropped;
+}
+
+void statusETag(const StatusKey& key, char* tag, size_t cap) {
+  snprintf(tag, cap, "W/\"%lu-%ld-%d-%lu\"", (unsigned long)key.version, (long)key.today,
+           key.firstSchedule, (unsigned long)key.dropped);
+}
 
-  // Build combined JSON response
-  String response = "{";
+// Renders everything after the wake-up rate; the object is opened by the
+// prefix that statusBody() puts in front
+void renderStatusCache(const StatusKey& key) {
+  JsonWriter json(statusCache + STATUS_PREFIX_ROOM, STATUS_BODY_MAX);
+  json.resume();
+
+  // 4. Version, for GET /status?wait=&version=
+  json.key("version").value(key.version);
+
+  // 5. Diagnostics
+  json.key("logDropped").value(key.dropped);
+
+  // 6. Schedules: the next STATUS_MAX_SCHEDULES to fire over the rest of
+  // today and tomorrow, by start time (later repeats are not listed
+  // separately). Without a synced clock, simply the next by time of day.
+  // The full table is available from GET /schedule
+  json.key("scheduleCount").value(scheduleCount);
+  json.key("dirty").value(scheduleDirty);
+  json.key("schedules").beginArray();
+  int listed = 0;
+  for (int n = 0; n < scheduleCount && listed < STATUS_MAX_SCHEDULES; n++) {
+    int pos = key.firstSchedule + n;
+    int id = scheduleOrder[pos % scheduleCount];
+    if (key.today > 0) {
+      int32_t day = pos < scheduleCount ? key.today : key.today + 1;
+      if (!scheduleRunsOnDay(id, day, (day + 4) % 7)) continue;  // 1970-01-01 was a Thursday
+    }
+    writeScheduleJson(json, id);
+    listed++;
+  }
+  json.endArray();
+
+  // 7. Learned press timing
+  portENTER_CRITICAL(&pressStatsMux);
+  uint16_t ewmaMs = pressStats.ewmaMs;
+  uint16_t samples = pressStats.count;
+  uint16_t p90Ms = pressP90Ms;
+  uint16_t settleMs = pressSettleMs;
+  uint16_t extraWaitMs = pressExtraWaitMs;
+  portEXIT_CRITICAL(&pressStatsMux);
+  json.key("press").beginObject()
+      .key("samples").value(samples)
+      .key("ewmaMs").value(ewmaMs)
+      .key("p90Ms").value(p90Ms)
+      .key("settleMs").value(settleMs)
+      .key("extraWaitMs").value(extraWaitMs)
+      .endObject();
+  json.endObject();
+
+  statusCacheTailLength = json.finish();
+  if (json.overflowed()) {
+    LOG_ERROR("[STATUS] ERROR: body truncated, raise STATUS_BODY_MAX\n");
+  }
+  statusCacheKey = key;
+  statusCacheValid = true;
+}
 
-  // 1. AC Status
-  response += "\"status\":\"";
-  response += acOn ? "1" : "0";
-  response += "\",";
+// Returns the complete body for key. The per-request part (AC status and
+// time) is written directly in front of the cached part, so the body is one
+// contiguous buffer that can be sent as is.
+const char* statusBody(const StatusKey& key, size_t& len) {
+  if (!statusCacheValid || !sameStatusKey(key, statusCacheKey)) {
+    renderStatusCache(key);
+  }
+
+  char prefix[STATUS_PREFIX_ROOM];
+  JsonWriter json(prefix, sizeof(prefix));
+
+  // 1. AC Status, as of the last version bump so body and version agree
+  json.beginObject().key("status").value(versionedAcOn ? "1" : "0");
 
   // 2. Time Info
+  json.key("time");
   struct tm timeinfo;
-  if (getLocalTime(&timeinfo)) {
-    char timeStr[64];
+  if (getLocalTime(&timeinfo, 0)) {
+    char timeStr[24];
     strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &timeinfo);
-
-    response += "\"time\":\"";
-    response += timeStr;
-    response += "\",";
+    json.value(timeStr);
   } else {
-    response += "\"time\":null,";
+    json.null();
   }
 
-  // 3. Schedules
-  response += "\"schedules\":[";
-  bool first = true;
-  for (int i = 0; i < 16; i++) {
-    if (schedules[i].valid) {
-      if (!first) response += ",";
-      first = false;
+  // 3. Loop wake-ups, like the time not part of the cache key
+  json.key("wakeupsPerSec").value((unsigned long)loopWakeupsPerSec);
+
+  char* start = statusCache + STATUS_PREFIX_ROOM - json.length();
+  memcpy(start, prefix, json.length());
+  len = json.length() + statusCacheTailLength;
+  return start;
+}
+
+// ========== Long-Poll Status ==========
+//
+// GET /status?wait=S&version=N answers immediately unless N is the current
+// version. Otherwise the connection is parked: WiFiClient is reference
+// counted, so keeping a copy keeps the socket open after WebServer moves on
+// to the next client. statusWaitTick() answers parked clients from loop()
+// as soon as the version changes or their wait expires, writing the HTTP
+// response itself. When all slots are taken, requests are answered at once.
+
+const int STATUS_MAX_WAITERS = 4;
+const int STATUS_MAX_WAIT_S = 60;
+
+struct StatusWaiter {
+  WiFiClient client;
+  uint32_t version;
+  unsigned long startMs;
+  unsigned long waitMs;
+  bool active;
+};
+
+StatusWaiter statusWaiters[STATUS_MAX_WAITERS];
+
+void sendRawStatus(WiFiClient& client, const char* body, size_t len) {
+  char head[128];
+  int headLen = snprintf(head, sizeof(head),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                         "Content-Length: %u\r\nConnection: close\r\n\r\n", (unsigned)len);
+  client.write((const uint8_t*)head, headLen);
+  client.write((const uint8_t*)body, len);
+  client.stop();
+}
+
+void statusWaitTick() {
+  uint32_t version = currentStateVersion();
+  unsigned long now = millis();
+  const char* body = nullptr;
+  size_t bodyLen = 0;
+  for (int i = 0; i < STATUS_MAX_WAITERS; i++) {
+    StatusWaiter& waiter = statusWaiters[i];
+    if (!waiter.active) continue;
+    if (!waiter.client.connected()) {
+      waiter.client.stop();
+      waiter.active = false;
+      continue;
+    }
+    if (waiter.version == version && now - waiter.startMs < waiter.waitMs) {
+      wakeLoopAt(waiter.startMs + waiter.waitMs);
+      continue;
+    }
+
+    // Built once per tick and shared by every waiter being answered
+    if (!body) body = statusBody(currentStatusKey(), bodyLen);
+    sendRawStatus(waiter.client, body, bodyLen);
+    waiter.client = WiFiClient();
+    waiter.active = false;
+  }
+}
 
-      response += "{\"id\":";
-      response += i;
-      response += ",\"hour\":";
-      response += schedules[i].hour;
-      response += ",\"minute\":";
-      response += schedules[i].minute;
-      response += ",\"switch\":";
-      response += schedules[i].switchState;
-      response += "}";
+void handleStatus() {
+  if (server.hasArg("wait") && server.hasArg("version") &&
+      (uint32_t)strtoul(server.arg("version").c_str(), nullptr, 10) == currentStateVersion()) {
+    int wait = server.arg("wait").toInt();
+    if (wait > STATUS_MAX_WAIT_S) wait = STATUS_MAX_WAIT_S;
+    for (int i = 0; wait > 0 && i < STATUS_MAX_WAITERS; i++) {
+      StatusWaiter& waiter = statusWaiters[i];
+      if (waiter.active) continue;
+      waiter.client = server.client();
+      waiter.version = currentStateVersion();
+      waiter.startMs = millis();
+      waiter.waitMs = wait * 1000UL;
+      waiter.active = true;
+      return;
     }
   }
-  response += "]";
-  response += "}\n";
 
-  server.send(200, "application/json", response);
+  StatusKey key = currentStatusKey();
+  char etag[STATUS_ETAG_SIZE];
+  statusETag(key, etag, sizeof(etag));
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", "no-cache");
+  if (server.header("If-None-Match") == etag) {
+    server.send(304);
+    return;
+  }
+
+  size_t len;
+  const char* body = statusBody(key, len);
+  server.send_P(200, "application/json", body, len);
+}
+
+// Answers 202 with the job id at once; progress is at GET /jobs?id=N and
+// the outcome also goes to the journal
+void handleSwitchRequest(bool desiredState) {
+  addToJournal(EV_MANUAL_REQUEST, desiredState);
+  uint32_t jobId = setOn(desiredState, -1);
+
+  char location[24];
+  snprintf(location, sizeof(location), "/jobs?id=%lu", (unsigned long)jobId);
+  server.sendHeader("Location", location);
+
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(202);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  // A request that joined a running job reports that job's progress
+  uint8_t state = jobs[jobId % JOB_RING_SIZE].state;
+  json.beginObject().key("job").value(jobId).key("state").value(JOB_STATE_NAMES[state]).endObject().finish();
 }
 
 void handleOn() {
-  addToJournal("Manual turn ON requested");
-  String result = setOn(true);
-  addToJournal("Manual turn ON result: " + result);
-  server.send(200, "text/plain", result);
+  handleSwitchRequest(true);
 }
 
 void handleOff() {
-  addToJournal("Manual turn OFF requested");
-  String result = setOn(false);
-  addToJournal("Manual turn OFF result: " + result);
-  server.send(200, "text/plain", result);
+  handleSwitchRequest(false);
 }
 
-void handleNotFound() {
-  String message = "Not Found\n\n";
-  message += "Available endpoints:\n";
-  message += "  GET  /status\n";
-  message += "  PUT  /on\n";
-  message += "  PUT  /off\n";
-  message += "  PUT  /synctime\n";
-  message += "  PUT  /schedule?id=X&hour=H&minute=M&switch=S\n";
-  message += "  DELETE /schedule?id=X\n";
-  message += "  GET  /journal\n";
-  message += "  DELETE /journal\n";
+void writeJobJson(JsonWriter& json, const Job& job) {
+  // Read once: the actuator task may be updating them
+  uint8_t state = job.state;
+  uint8_t retries = job.retries;
+
+  json.beginObject().key("id").value(job.id).key("switch").value(job.desiredState ? 1 : 0);
+  if (job.scheduleId >= 0) json.key("schedule").value(job.scheduleId);
+  json.key("state").value(JOB_STATE_NAMES[state]).key("retries").value(retries);
+  if (job.merged > 0) json.key("merged").value(job.merged);
+  json.endObject();
+}
+
+// ?id=N returns one job, without it the whole ring, newest first
+void handleGetJobs() {
+  char buf[JSON_BUFFER_SIZE];
 
-  server.send(404, "text/plain", message);
+  if (server.hasArg("id")) {
+    Job* job = findJob(strtoul(server.arg("id").c_str(), nullptr, 10));
+    if (!job) {
+      sendJsonError(404, "Job not found (unknown or expired)");
+      return;
+    }
+    ResponseSink sink(200);
+    JsonWriter json(buf, sizeof(buf), &sink);
+    writeJobJson(json, *job);
+    json.finish();
+    return;
+  }
+
+  ResponseSink sink(200);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginArray();
+  for (uint32_t n = 1; n <= (uint32_t)JOB_RING_SIZE; n++) {
+    Job* job = findJob(nextJobId - n);
+    if (job) writeJobJson(json, *job);
+  }
+  json.endArray().finish();
+}
+
+void handleNotFound() {
+  static const char message[] =
+      "Not Found\n\n"
+      "Available endpoints:\n"
+      "  GET  /status[?wait=S&version=N]\n"
+      "  GET  /events  (Server-Sent Events)\n"
+      "  PUT  /on\n"
+      "  PUT  /off\n"
+      "  GET  /jobs[?id=N]\n"
+      "  PUT  /synctime\n"
+      "  GET  /schedule\n"
+      "  PUT  /schedule?id=X&hour=H&minute=M&switch=S\n"
+      "  DELETE /schedule?id=X\n"
+      "  PUT  /schedules  (JSON array body)\n"
+      "  PUT  /commit\n"
+      "  GET  /journal[?since=N&limit=M]\n"
+      "  DELETE /journal\n";
+
+  server.send_P(404, "text/plain", message, sizeof(message) - 1);
 }
 
 // ========== New HTTP Endpoint Handlers ==========
 
-void handleGetJournal() {
-  String response = "";
+void journalStreamRecord(char* chunk, size_t& used, const JournalRecord& record) {
+  if (JOURNAL_STREAM_CHUNK - used < JOURNAL_MAX_LINE + 1) {
+    server.sendContent(chunk, used);
+    used = 0;
+  }
+  used += formatJournalRecord(record, chunk + used, JOURNAL_MAX_LINE);
+  chunk[used++] = '\n';
+}
 
-  int startIdx = (journalCount < JOURNAL_MAX_LINES) ? 0 : journalIndex;
+// Streams the journal with chunked transfer encoding through a small stack
+// buffer, so memory use does not depend on how many entries are stored.
+// Entries older than the RAM ring are read from flash segments.
+//
+// Optional cursor: ?since=N returns only entries with sequence number > N,
+// ?limit=M caps the number of entries. X-Journal-Next carries the cursor for
+// the next call, X-Journal-Lost the number of entries after N that were
+// already evicted.
+void handleGetJournal() {
+  uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(), nullptr, 10) : 0;
+  uint32_t limit = server.hasArg("limit") ? strtoul(server.arg("limit").c_str(), nullptr, 10) : 0;
+
+  // A cursor from the future comes from before a reboot; start over
+  if (since >= journalNextSeq) since = 0;
+
+  uint32_t oldestSeq = journalOldestSeq();
+  uint32_t firstSeq = since + 1 > oldestSeq ? since + 1 : oldestSeq;
+  uint32_t lastSeq = journalNextSeq - 1;
+  // Compared as a count so a huge limit cannot wrap around
+  if (limit > 0 && limit < lastSeq - firstSeq + 1) {
+    lastSeq = firstSeq + limit - 1;
+  }
+  uint32_t lost = firstSeq - (since + 1);
+  uint32_t next = firstSeq <= lastSeq ? lastSeq : since;
+
+  char nextText[12];
+  char lostText[12];
+  snprintf(nextText, sizeof(nextText), "%lu", (unsigned long)next);
+  snprintf(lostText, sizeof(lostText), "%lu", (unsigned long)lost);
+  server.sendHeader("X-Journal-Next", nextText);
+  server.sendHeader("X-Journal-Lost", lostText);
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+
+  char chunk[JOURNAL_STREAM_CHUNK];
+  size_t used = 0;
+  JournalRecord record;
+
+#if JOURNAL_PERSIST
+  uint32_t ramOldestSeq = journalNextSeq - journalCount;
+  if (firstSeq < ramOldestSeq) {
+    JournalFileIterator fileIt = journalPersistBegin(firstSeq);
+    while (journalPersistNext(fileIt, record)) {
+      if (record.seq >= ramOldestSeq || record.seq > lastSeq) break;
+      if (record.seq < firstSeq) continue;
+      journalStreamRecord(chunk, used, record);
+    }
+    fileIt.file.close();
+  }
+#endif
 
-  for (int i = 0; i < journalCount; i++) {
-    int idx = (startIdx + i) % JOURNAL_MAX_LINES;
-    response += journal[idx];
-    response += "\n";
+  JournalIterator it = journalBegin();
+  while (journalNext(it, record)) {
+    if (record.seq > lastSeq) break;
+    if (record.seq < firstSeq) continue;
+    journalStreamRecord(chunk, used, record);
   }
-  server.send(200, "text/plain", response);
+  if (used > 0) {
+    server.sendContent(chunk, used);
+  }
+  server.sendContent("");
 }
 
 void handleDeleteJournal() {
   clearJournal();
-  server.send(200, "application/json", "{\"status\": \"cleared\"}\n");
+  sendJsonStatus(200, "cleared");
 }
 
 void handleSyncTime() {
   if (WiFi.status() != WL_CONNECTED) {
-    server.send(503, "application/json", "{\"error\": \"WiFi not connected\"}\n");
+    sendJsonError(503, "WiFi not connected");
     return;
   }
 
   manualSyncTime();
-  server.send(200, "application/json", "{\"status\": \"syncing\"}\n");
+  sendJsonStatus(200, "syncing");
+}
+
+void sendScheduleIdError() {
+  char message[24];
+  snprintf(message, sizeof(message), "id must be 0-%d", SCHEDULE_CAPACITY - 1);
+  sendJsonError(400, message);
+}
+
+// Lists every schedule in id order. Larger tables go out in chunks, so the
+// response size does not depend on how many schedules exist.
+void handleGetSchedules() {
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(200);
+  JsonWriter json(buf, sizeof(buf), &sink);
+
+  json.beginArray();
+  for (int id = 0; id < SCHEDULE_CAPACITY; id++) {
+    if (isScheduleValid(id)) writeScheduleJson(json, id);
+  }
+  json.endArray().finish();
+}
+
+// "mon,wed,fri" -> weekday mask (bit 0 = Sunday). False on an unknown name.
+bool parseWeekdays(const char* p, int& mask) {
+  mask = 0;
+  while (*p) {
+    int d = 0;
+    while (d < 7 && strncasecmp(p, WEEKDAY_NAMES[d], 3) != 0) d++;
+    if (d == 7 || (p[3] != ',' && p[3] != '\0')) return false;
+    mask |= 1 << d;
+    p += p[3] == ',' ? 4 : 3;
+  }
+  return mask != 0;
+}
+
+// "YYYY-MM-DD" -> local day number
+bool parseDate(const char* text, int32_t& day) {
+  int year, month, dayOfMonth;
+  if (sscanf(text, "%4d-%2d-%2d", &year, &month, &dayOfMonth) != 3) return false;
+  if (month < 1 || month > 12 || dayOfMonth < 1 || dayOfMonth > 31) return false;
+  day = daysFromCivil(year, month, dayOfMonth);
+  if (day <= 0 || day >= SCHEDULE_OPEN_END) return false;
+
+  // Rejects days past the end of the month (2025-02-30 would become March 2)
+  int checkYear, checkMonth, checkDay;
+  civilFromDays(day, checkYear, checkMonth, checkDay);
+  return checkMonth == month && checkDay == dayOfMonth;
+}
+
+// "HH:MM" -> minute of day
+bool parseTimeOfDay(const char* text, int& minute) {
+  int hour, min;
+  if (sscanf(text, "%2d:%2d", &hour, &min) != 2) return false;
+  if (hour < 0 || hour > 23 || min < 0 || min > 59) return false;
+  minute = hour * 60 + min;
+  return true;
+}
+
+// Schedule fields as received, from query parameters or from a JSON object.
+// Absent numbers are FIELD_MISSING, absent strings are nullptr.
+const int FIELD_MISSING = INT32_MIN;
+
+struct ScheduleFields {
+  int hour;
+  int minute;
+  int switchState;
+  int every;
+  const char* days;
+  const char* from;
+  const char* to;
+  const char* until;
+};
+
+// Validates the fields and packs them. Returns nullptr on success or the
+// error message to report; the messages contain no characters needing JSON
+// escaping.
+const char* buildSchedule(const ScheduleFields& f, ScheduleEntry& entry, ScheduleRule& rule, bool& hasRule) {
+  if (f.hour == FIELD_MISSING || f.minute == FIELD_MISSING || f.switchState == FIELD_MISSING) {
+    return "Missing parameters. Required: id, hour, minute, switch";
+  }
+  if (f.hour < 0 || f.hour > 23) return "hour must be 0-23";
+  if (f.minute < 0 || f.minute > 59) return "minute must be 0-59";
+  if (f.switchState != 0 && f.switchState != 1) return "switch must be 0 or 1";
+
+  int weekdays = 0;
+  if (f.days && !parseWeekdays(f.days, weekdays)) return "days must be a list like mon,wed,fri";
+
+  rule.firstDay = 0;
+  rule.lastDay = SCHEDULE_OPEN_END;
+  rule.interval = 0;
+  rule.untilMinute = 0;
+  int32_t day;
+  if (f.from) {
+    if (!parseDate(f.from, day)) return "from must be a valid YYYY-MM-DD date";
+    rule.firstDay = day;
+  }
+  if (f.to) {
+    if (!parseDate(f.to, day)) return "to must be a valid YYYY-MM-DD date";
+    rule.lastDay = day;
+  }
+  if (rule.firstDay > rule.lastDay) return "from must not be after to";
+
+  if (f.every != FIELD_MISSING) {
+    if (f.every < 1 || f.every >= MINUTES_PER_DAY) return "every must be 1-1439 minutes";
+    int untilMinute = MINUTES_PER_DAY - 1;
+    if (f.until && !parseTimeOfDay(f.until, untilMinute)) return "until must be HH:MM";
+    if (untilMinute < f.hour * 60 + f.minute) return "until must not be before the start time";
+    rule.interval = f.every;
+    rule.untilMinute = untilMinute;
+  } else if (f.until) {
+    return "until requires every";
+  }
+
+  hasRule = f.from || f.to || rule.interval > 0;
+  entry = packSchedule(f.hour, f.minute, f.switchState, weekdays);
+  return nullptr;
+}
+
+// {"status":"<status>","id":<id>}
+void sendScheduleResult(const char* status, int id) {
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(200);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("status").value(status).key("id").value(id).endObject().finish();
 }
 
+// Optional parameters:
+//   days=mon,tue,...      weekdays the schedule runs on (default: every day)
+//   from=YYYY-MM-DD       first day (inclusive)
+//   to=YYYY-MM-DD         last day (inclusive)
+//   every=N&until=HH:MM   repeat every N minutes after the start time, up to HH:MM
 void handlePutSchedule() {
   if (!server.hasArg("id") || !server.hasArg("hour") || 
       !server.hasArg("minute") || !server.hasArg("switch")) {
-    server.send(400, "application/json", 
-                "{\"error\": \"Missing parameters. Required: id, hour, minute, switch\"}\n");
+    sendJsonError(400, "Missing parameters. Required: id, hour, minute, switch");
     return;
   }
   
   int id = server.arg("id").toInt();
-  int hour = server.arg("hour").toInt();
-  int minute = server.arg("minute").toInt();
-  int switchState = server.arg("switch").toInt();
   
-  if (id < 0 || id >= 16) {
-    server.send(400, "application/json", "{\"error\": \"id must be 0-15\"}\n");
+  if (!isScheduleId(id)) {
+    sendScheduleIdError();
     return;
   }
-  if (hour < 0 || hour > 23) {
-    server.send(400, "application/json", "{\"error\": \"hour must be 0-23\"}\n");
-    return;
-  }
-  if (minute < 0 || minute > 59) {
-    server.send(400, "application/json", "{\"error\": \"minute must be 0-59\"}\n");
+
+  // Held here so the c_str() pointers below stay valid
+  String days = server.arg("days");
+  String from = server.arg("from");
+  String to = server.arg("to");
+  String until = server.arg("until");
+
+  ScheduleFields fields;
+  fields.hour = server.arg("hour").toInt();
+  fields.minute = server.arg("minute").toInt();
+  fields.switchState = server.arg("switch").toInt();
+  fields.every = server.hasArg("every") ? server.arg("every").toInt() : FIELD_MISSING;
+  fields.days = server.hasArg("days") ? days.c_str() : nullptr;
+  fields.from = server.hasArg("from") ? from.c_str() : nullptr;
+  fields.to = server.hasArg("to") ? to.c_str() : nullptr;
+  fields.until = server.hasArg("until") ? until.c_str() : nullptr;
+
+  ScheduleEntry entry;
+  ScheduleRule rule;
+  bool hasRule;
+  const char* error = buildSchedule(fields, entry, rule, hasRule);
+  if (error) {
+    sendJsonError(400, error);
     return;
   }
-  if (switchState != 0 && switchState != 1) {
-    server.send(400, "application/json", "{\"error\": \"switch must be 0 or 1\"}\n");
+
+  if (!setSchedule(id, entry, hasRule ? &rule : nullptr)) {
+    sendJsonError(507, "No room for more date-range or repeating schedules");
     return;
   }
   
-  schedules[id].id = id;
-  schedules[id].hour = hour;
-  schedules[id].minute = minute;
-  schedules[id].switchState = switchState;
-  schedules[id].executed = false;
-  schedules[id].valid = true;
+  markSchedulesDirty();
+  rescheduleNextDue();
   
-  saveScheduleToNVS(id);
-  
-  String response = "{\"status\": \"ok\", \"id\": ";
-  response += id;
-  response += "}\n";
-  
-  server.send(200, "application/json", response);
+  sendScheduleResult("ok", id);
 }
 
 void handleDeleteSchedule() {
   if (!server.hasArg("id")) {
-    server.send(400, "application/json", "{\"error\": \"Missing id parameter\"}\n");
+    sendJsonError(400, "Missing id parameter");
     return;
   }
   
   int id = server.arg("id").toInt();
   
-  if (id < 0 || id >= 16) {
-    server.send(400, "application/json", "{\"error\": \"id must be 0-15\"}\n");
+  if (!isScheduleId(id)) {
+    sendScheduleIdError();
     return;
   }
   
-  if (!schedules[id].valid) {
-    server.send(404, "application/json", "{\"error\": \"Schedule not found\"}\n");
+  if (!isScheduleValid(id)) {
+    sendJsonError(404, "Schedule not found");
     return;
   }
   
-  deleteScheduleFromNVS(id);
+  clearSchedule(id);
+  markSchedulesDirty();
+  rescheduleNextDue();
   
-  String response = "{\"status\": \"deleted\", \"id\": ";
-  response += id;
-  response += "}\n";
-  
-  server.send(200, "application/json", response);
+  sendScheduleResult("deleted", id);
+}
+
+// ========== Bulk Schedule Upload ==========
+//
+// PUT /schedules takes the complete schedule set as a JSON array of objects
+// using the same fields as GET /schedule. The body is parsed in place:
+// strings are terminated inside the request buffer and passed on as
+// pointers, so nothing is copied. Only what the endpoint needs is accepted:
+// flat objects with integer or plain (unescaped) string values.
+//
+// Every entry is validated into a staging table first; the live table is
+// only replaced, and saved in a single NVS commit, if all of them are valid.
+
+const int BULK_MAX_ERRORS = 16;
+
+struct BulkError {
+  int index;
+  const char* error;
+};
+
+ScheduleEntry bulkSchedules[SCHEDULE_CAPACITY];
+BulkError bulkErrors[BULK_MAX_ERRORS];
+ScheduleRule bulkRules[SCHEDULE_RULE_CAPACITY];
+int16_t bulkRuleOwner[SCHEDULE_RULE_CAPACITY];
+
+void jsonSkipSpace(char*& p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+}
+
+bool jsonExpect(char*& p, char c) {
+  jsonSkipSpace(p);
+  if (*p != c) return false;
+  p++;
+  return true;
+}
+
+// Terminates the string in place and points out at its first character
+bool jsonString(char*& p, char*& out) {
+  jsonSkipSpace(p);
+  if (*p != '"') return false;
+  out = ++p;
+  while (*p && *p != '"') {
+    if (*p == '\\') return false;
+    p++;
+  }
+  if (*p != '"') return false;
+  *p++ = '\0';
+  return true;
+}
+
+bool jsonInt(char*& p, int& out) {
+  jsonSkipSpace(p);
+  char* end;
+  long value = strtol(p, &end, 10);
+  if (end == p) return false;
+  p = end;
+  // Out-of-range values only need to fail validation
+  out = value < -1 ? -1 : value > 0xFFFF ? 0xFFFF : (int)value;
+  return true;
+}
+
+// Reads one object. Returns false on a syntax error; a field that is
+// well-formed but not understood is reported through error instead.
+bool jsonScheduleObject(char*& p, int& id, ScheduleFields& f, const char*& error) {
+  id = FIELD_MISSING;
+  f.hour = f.minute = f.switchState = f.every = FIELD_MISSING;
+  f.days = f.from = f.to = f.until = nullptr;
+
+  if (!jsonExpect(p, '{')) return false;
+  jsonSkipSpace(p);
+  if (*p == '}') {
+    p++;
+    error = "Missing parameters. Required: id, hour, minute, switch";
+    return true;
+  }
+
+  do {
+    char* key;
+    if (!jsonString(p, key) || !jsonExpect(p, ':')) return false;
+    jsonSkipSpace(p);
+    if (*p == '"') {
+      char* text;
+      if (!jsonString(p, text)) return false;
+      if (strcmp(key, "days") == 0) f.days = text;
+      else if (strcmp(key, "from") == 0) f.from = text;
+      else if (strcmp(key, "to") == 0) f.to = text;
+      else if (strcmp(key, "until") == 0) f.until = text;
+      else if (!error) error = "unknown field or wrong value type";
+    } else {
+      int value;
+      if (!jsonInt(p, value)) return false;
+      if (strcmp(key, "id") == 0) id = value;
+      else if (strcmp(key, "hour") == 0) f.hour = value;
+      else if (strcmp(key, "minute") == 0) f.minute = value;
+      else if (strcmp(key, "switch") == 0) f.switchState = value;
+      else if (strcmp(key, "every") == 0) f.every = value;
+      else if (!error) error = "unknown field or wrong value type";
+    }
+  } while (jsonExpect(p, ','));
+
+  return jsonExpect(p, '}');
+}
+
+void sendBulkSyntaxError(const String& body, const char* p) {
+  char message[40];
+  snprintf(message, sizeof(message), "Invalid JSON at offset %d", (int)(p - body.c_str()));
+  sendJsonError(400, message);
+}
+
+void handlePutSchedules() {
+  if (!server.hasArg("plain")) {
+    sendJsonError(400, "Missing JSON body");
+    return;
+  }
+
+  String body = server.arg("plain");
+  char* p = body.begin();
+
+  memset(bulkSchedules, 0, sizeof(bulkSchedules));
+  int entryCount = 0;
+  int ruleCount = 0;
+  int errorCount = 0;
+
+  if (!jsonExpect(p, '[')) {
+    sendBulkSyntaxError(body, p);
+    return;
+  }
+  jsonSkipSpace(p);
+  if (*p == ']') {
+    p++;
+  } else {
+    do {
+      int id;
+      ScheduleFields fields;
+      const char* error = nullptr;
+      if (!jsonScheduleObject(p, id, fields, error)) {
+        sendBulkSyntaxError(body, p);
+        return;
+      }
+
+      ScheduleEntry entry = 0;
+      ScheduleRule rule;
+      bool hasRule = false;
+      if (!error && !isScheduleId(id)) error = "id missing or out of range";
+      if (!error && bulkSchedules[id]) error = "duplicate id";
+      if (!error) error = buildSchedule(fields, entry, rule, hasRule);
+      if (!error && hasRule && ruleCount == SCHEDULE_RULE_CAPACITY) {
+        error = "No room for more date-range or repeating schedules";
+      }
+
+      if (error) {
+        if (errorCount < BULK_MAX_ERRORS) {
+          bulkErrors[errorCount].index = entryCount;
+          bulkErrors[errorCount].error = error;
+        }
+        errorCount++;
+      } else {
+        bulkSchedules[id] = entry;
+        if (hasRule) {
+          bulkRules[ruleCount] = rule;
+          bulkRuleOwner[ruleCount++] = id;
+        }
+      }
+      entryCount++;
+    } while (jsonExpect(p, ','));
+
+    if (!jsonExpect(p, ']')) {
+      sendBulkSyntaxError(body, p);
+      return;
+    }
+  }
+  jsonSkipSpace(p);
+  if (*p) {
+    sendBulkSyntaxError(body, p);
+    return;
+  }
+
+  if (errorCount > 0) {
+    char message[48];
+    snprintf(message, sizeof(message), "%d invalid entries, nothing was changed", errorCount);
+
+    char buf[JSON_BUFFER_SIZE];
+    ResponseSink sink(400);
+    JsonWriter json(buf, sizeof(buf), &sink);
+    json.beginObject().key("error").value(message).key("errors").beginArray();
+    for (int n = 0; n < errorCount && n < BULK_MAX_ERRORS; n++) {
+      json.beginObject().key("index").value(bulkErrors[n].index).key("error").value(bulkErrors[n].error).endObject();
+    }
+    json.endArray().endObject().finish();
+    return;
+  }
+
+  // Everything is valid: swap the table. The rule pool was size-checked
+  // above, so setSchedule() cannot fail here.
+  for (int id = 0; id < SCHEDULE_CAPACITY; id++) {
+    if (isScheduleValid(id)) clearSchedule(id);
+  }
+  for (int id = 0; id < SCHEDULE_CAPACITY; id++) {
+    if (!bulkSchedules[id]) continue;
+    const ScheduleRule* rule = nullptr;
+    for (int r = 0; r < ruleCount && !rule; r++) {
+      if (bulkRuleOwner[r] == id) rule = &bulkRules[r];
+    }
+    setSchedule(id, bulkSchedules[id], rule);
+  }
+
+  markSchedulesDirty();
+  flushSchedules();
+  rescheduleNextDue();
+
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(200);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("status").value("ok").key("count").value(scheduleCount).endObject().finish();
+}
+
+void handleCommit() {
+  bool saved = flushSchedules();
+
+  char buf[JSON_BUFFER_SIZE];
+  ResponseSink sink(200);
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("status").value("committed").key("saved").value(saved).endObject().finish();
 }
 
 void setup() {
+  loopTask = xTaskGetCurrentTaskHandle();  // setup() and loop() share the Arduino loop task
+#if AC_LOG_LEVEL > LOG_LEVEL_NONE
   Serial.begin(115200);
   delay(100);
+  initLogger();
+#endif
   
   initGPIO();
+  initActuator();
+#if JOURNAL_PERSIST
+  initJournalPersist();
+#endif
   
+  initScheduleStore();
   loadSchedulesFromNVS();
+  initScheduleFlush();
+  initScheduleTimer();
   
   WiFi.mode(WIFI_STA);
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
@@ -465,44 +3058,62 @@ void setup() {
   int attempts = 0;
   while (WiFi.status() != WL_CONNECTED) {
     delay(500);
-    Serial.print(".");
+    LOG_INFO(".");
     attempts++;
     
     if (attempts > 60) {  // 30 seconds timeout
-      Serial.println();
-      Serial.println("[WiFi] ERROR: Connection timeout!");
-      Serial.println("[WiFi] Please check credentials and restart.");
+      LOG_ERROR("\n[WiFi] ERROR: Connection timeout!\n");
+      LOG_ERROR("[WiFi] Please check credentials and restart.\n");
       while (true) {
         delay(1000);  // Halt here
       }
     }
   }
   
-  Serial.println("[WiFi] Connected!");
-  Serial.print("[WiFi] IP address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO("[WiFi] Connected!\n");
+  LOG_INFO("[WiFi] IP address: %s\n", WiFi.localIP().toString().c_str());
   
   initTime();
   
   server.on("/status", HTTP_GET, handleStatus);
+  server.on("/events", HTTP_GET, handleEvents);
   server.on("/on", HTTP_PUT, handleOn);
   server.on("/off", HTTP_PUT, handleOff);
+  server.on("/jobs", HTTP_GET, handleGetJobs);
   server.on("/synctime", HTTP_PUT, handleSyncTime);
+  server.on("/schedule", HTTP_GET, handleGetSchedules);
   server.on("/schedule", HTTP_PUT, handlePutSchedule);
   server.on("/schedule", HTTP_DELETE, handleDeleteSchedule);
+  server.on("/schedules", HTTP_PUT, handlePutSchedules);
+  server.on("/commit", HTTP_PUT, handleCommit);
   server.on("/journal", HTTP_GET, handleGetJournal);
   server.on("/journal", HTTP_DELETE, handleDeleteJournal);
   server.onNotFound(handleNotFound);
+  static const char* collectedHeaders[] = { "If-None-Match" };
+  server.collectHeaders(collectedHeaders, 1);
   
   server.begin();
-  Serial.println();
-  Serial.print("[HTTP] Server started on port ");
-  Serial.println(HTTP_PORT);
-  Serial.println();
+  initNetWatcher();
+  LOG_INFO("\n[HTTP] Server started on port %d\n\n", HTTP_PORT);
+  LOG_INFO("[BOOT] setup() finished at %lu ms\n", millis());
 }
 
 void loop() {
-  server.handleClient();
+  uint32_t reasons = waitForLoopWake();
+
+  ledSenseTick();
+  stateVersionTick();
+  if (reasons & WAKE_NET) {
+    server.handleClient();
+    rearmNetWatcher();
+  }
   checkSchedules();
-  delay(20);
+  actuationTick();
+  scheduleFlushTick();
+  // Last, so they see version bumps and journal events from this pass
+  statusWaitTick();
+  eventsTick();
+#if JOURNAL_PERSIST
+  journalPersistTick();
+#endif
 }
@@ -0,0 +1,282 @@
+/*
+ * Host micro-benchmark for include/JsonWriter.h
+ *
+ * Builds three documents in the shapes the firmware sends: the GET /status
+ * body as statusBody() and renderStatusCache() lay it out (16 upcoming
+ * schedules), the bare array GET /schedule returns for a 40-entry table,
+ * and a sendJsonError() reply. Schedule objects follow writeScheduleJson():
+ * optional days, from/to and every/until fields appear on a mix of entries.
+ * Each document is built two ways: by String-style concatenation, as the
+ * handlers did before JsonWriter, and with JsonWriter writing into a
+ * 512-byte stack buffer flushed to a sink. Heap allocations are counted by
+ * replacing the global operator new; std::string stands in for Arduino's
+ * String.
+ *
+ * Not a PlatformIO test suite (those live in test_* folders). Build and run
+ * on the host:
+ *
+ *   g++ -std=gnu++11 -O2 -Wall -Wextra -Iinclude \
+ *       test/bench_json_writer/bench_json_writer.cpp -o bench_json_writer
+ *   ./bench_json_writer
+ *
+ * Results (x86-64, g++ 12.2, -O2, typical of three runs):
+ *
+ *   document    bytes   concat allocs/ns   JsonWriter allocs/ns
+ *   status       1245        6.0 /   2350        0.0 /   2050
+ *   schedule     2641        8.0 /   5400        0.0 /   4350
+ *   error          31        2.0 /     70        0.0 /     22
+ *
+ * On the host JsonWriter is somewhat faster; the main difference is the
+ * heap. std::string doubles its capacity and keeps short strings inline,
+ * so it understates the concatenation count. Arduino's String reallocates
+ * to the exact length on each append, which makes it roughly one
+ * allocation per += on the device.
+ *
+ * Allocations that remain per request on the device are in the WebServer
+ * API, not in the handlers: arg() returns a String by value (heap only for
+ * values longer than String's 11-byte inline buffer, so for PUT /schedule
+ * only long days= lists, and for PUT /schedules always the request body),
+ * and sendHeader() takes String name and value (the /status ETag and
+ * Cache-Control, GET /journal's X-Journal-Next / X-Journal-Lost, the
+ * Location of a new job).
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "JsonWriter.h"
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static const int ITERATIONS = 20000;
+static const int STATUS_SCHEDULES = 16;  // STATUS_MAX_SCHEDULES
+static const int TABLE_SCHEDULES = 40;
+
+// Schedule fields as writeScheduleJson() emits them; nullptr / 0 = omitted
+struct ScheduleFixture {
+  int id;
+  int hour;
+  int minute;
+  int switchState;
+  const char* days;
+  const char* from;
+  const char* to;
+  int every;
+  const char* until;
+};
+
+static ScheduleFixture fixture(int n) {
+  static const char* DAYS[] = { nullptr, "mon,tue,wed,thu,fri", nullptr, "sat,sun" };
+  ScheduleFixture f = { n * 5 + 1, n * 7 % 24, n * 13 % 60, n & 1, DAYS[n % 4], nullptr, nullptr, 0, nullptr };
+  if (n % 5 == 2) {
+    f.from = "2026-06-01";
+    f.to = "2026-09-30";
+  }
+  if (n % 7 == 3) {
+    f.every = 30;
+    f.until = "22:00";
+  }
+  return f;
+}
+
+// Stands in for the client socket. Output is only captured (which
+// allocates) on the untimed run that compares the two builders.
+class CountingSink : public JsonSink {
+ public:
+  size_t bytes = 0;
+  std::string* capture = nullptr;
+
+  void write(const char* data, size_t len, bool) override {
+    bytes += len;
+    if (capture) capture->append(data, len);
+  }
+};
+
+// ---- String concatenation, the pre-JsonWriter handlers ----
+
+static void concatQuoted(std::string& out, const char* key, const char* value) {
+  out += ",\"";
+  out += key;
+  out += "\":\"";
+  out += value;
+  out += "\"";
+}
+
+static void concatSchedule(std::string& out, const ScheduleFixture& f) {
+  out += "{\"id\":";
+  out += std::to_string(f.id);
+  out += ",\"hour\":";
+  out += std::to_string(f.hour);
+  out += ",\"minute\":";
+  out += std::to_string(f.minute);
+  out += ",\"switch\":";
+  out += std::to_string(f.switchState);
+  if (f.days) concatQuoted(out, "days", f.days);
+  if (f.from) concatQuoted(out, "from", f.from);
+  if (f.to) concatQuoted(out, "to", f.to);
+  if (f.every) {
+    out += ",\"every\":";
+    out += std::to_string(f.every);
+    concatQuoted(out, "until", f.until);
+  }
+  out += "}";
+}
+
+static size_t concatStatus(CountingSink& sink) {
+  std::string out = "{\"status\":\"1\",\"time\":\"2026-10-16 12:00:00\"";
+  out += ",\"wakeupsPerSec\":";
+  out += std::to_string(1);
+  out += ",\"version\":";
+  out += std::to_string(42);
+  out += ",\"logDropped\":";
+  out += std::to_string(0);
+  out += ",\"scheduleCount\":";
+  out += std::to_string(TABLE_SCHEDULES);
+  out += ",\"dirty\":false,\"schedules\":[";
+  for (int i = 0; i < STATUS_SCHEDULES; i++) {
+    if (i > 0) out += ",";
+    concatSchedule(out, fixture(i));
+  }
+  out += "],\"press\":{\"samples\":";
+  out += std::to_string(32);
+  out += ",\"ewmaMs\":";
+  out += std::to_string(180);
+  out += ",\"p90Ms\":";
+  out += std::to_string(240);
+  out += ",\"settleMs\":";
+  out += std::to_string(340);
+  out += ",\"extraWaitMs\":";
+  out += std::to_string(680);
+  out += "}}\n";
+  sink.write(out.data(), out.size(), true);
+  return out.size();
+}
+
+static size_t concatScheduleTable(CountingSink& sink) {
+  std::string out = "[";
+  for (int i = 0; i < TABLE_SCHEDULES; i++) {
+    if (i > 0) out += ",";
+    concatSchedule(out, fixture(i));
+  }
+  out += "]\n";
+  sink.write(out.data(), out.size(), true);
+  return out.size();
+}
+
+static size_t concatError(CountingSink& sink) {
+  std::string out = "{\"error\":\"";
+  out += "Schedule not found";
+  out += "\"}\n";
+  sink.write(out.data(), out.size(), true);
+  return out.size();
+}
+
+// ---- JsonWriter, as in main.cpp ----
+
+static void writeSchedule(JsonWriter& json, const ScheduleFixture& f) {
+  json.beginObject()
+      .key("id").value(f.id)
+      .key("hour").value(f.hour)
+      .key("minute").value(f.minute)
+      .key("switch").value(f.switchState);
+  if (f.days) json.key("days").value(f.days);
+  if (f.from) json.key("from").value(f.from);
+  if (f.to) json.key("to").value(f.to);
+  if (f.every) json.key("every").value(f.every).key("until").value(f.until);
+  json.endObject();
+}
+
+static size_t writerStatus(CountingSink& sink) {
+  char buf[512];
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("status").value("1").key("time").value("2026-10-16 12:00:00");
+  json.key("wakeupsPerSec").value(1);
+  json.key("version").value(42);
+  json.key("logDropped").value(0);
+  json.key("scheduleCount").value(TABLE_SCHEDULES);
+  json.key("dirty").value(false);
+  json.key("schedules").beginArray();
+  for (int i = 0; i < STATUS_SCHEDULES; i++) writeSchedule(json, fixture(i));
+  json.endArray();
+  json.key("press").beginObject()
+      .key("samples").value(32)
+      .key("ewmaMs").value(180)
+      .key("p90Ms").value(240)
+      .key("settleMs").value(340)
+      .key("extraWaitMs").value(680)
+      .endObject();
+  json.endObject();
+  return json.finish();
+}
+
+static size_t writerScheduleTable(CountingSink& sink) {
+  char buf[512];
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginArray();
+  for (int i = 0; i < TABLE_SCHEDULES; i++) writeSchedule(json, fixture(i));
+  json.endArray();
+  return json.finish();
+}
+
+static size_t writerError(CountingSink& sink) {
+  char buf[512];
+  JsonWriter json(buf, sizeof(buf), &sink);
+  json.beginObject().key("error").value("Schedule not found").endObject();
+  return json.finish();
+}
+
+struct Result {
+  std::string output;
+  double allocsPerRequest;
+  double nsPerRequest;
+};
+
+static Result run(size_t (*build)(CountingSink&)) {
+  CountingSink sink;
+  Result result;
+  sink.capture = &result.output;
+  build(sink);
+  sink.capture = nullptr;
+
+  unsigned long before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) build(sink);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  result.allocsPerRequest = (double)(allocations - before) / ITERATIONS;
+  result.nsPerRequest = std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+  return result;
+}
+
+static bool report(const char* name, size_t (*concat)(CountingSink&), size_t (*writer)(CountingSink&)) {
+  Result a = run(concat);
+  Result b = run(writer);
+  printf("%-10s %6zu   %8.1f / %6.0f   %8.1f / %6.0f\n", name, b.output.size(),
+         a.allocsPerRequest, a.nsPerRequest, b.allocsPerRequest, b.nsPerRequest);
+  if (a.output != b.output) {
+    printf("  MISMATCH: the two builders produced different output\n");
+    return false;
+  }
+  return b.allocsPerRequest == 0;
+}
+
+int main() {
+  printf("document    bytes   concat allocs/ns   JsonWriter allocs/ns\n");
+  bool ok = true;
+  ok &= report("status", concatStatus, writerStatus);
+  ok &= report("schedule", concatScheduleTable, writerScheduleTable);
+  ok &= report("error", concatError, writerError);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
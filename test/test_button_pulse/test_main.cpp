@@ -0,0 +1,160 @@
+/*
+ * Host test for include/ButtonPulse.h against a mock timer and line
+ *
+ * Runs on the host with PlatformIO's native environment:
+ *
+ *   pio test -e native
+ */
+#include <unity.h>
+
+#include "ButtonPulse.h"
+
+// Records what was armed; the test fires it by hand
+class MockTimer : public PulseTimer {
+ public:
+  bool armed = false;
+  uint32_t armedUs = 0;
+  int armCount = 0;
+  bool failArm = false;
+
+  bool arm(uint32_t us) override {
+    armCount++;
+    if (failArm) return false;
+    armed = true;
+    armedUs = us;
+    return true;
+  }
+
+  bool disarm() override {
+    bool was = armed;
+    armed = false;
+    return was;
+  }
+
+  // What the esp_timer callback does on the device
+  void fire(ButtonPulse& pulse) {
+    armed = false;
+    pulse.expire();
+  }
+};
+
+class MockLine : public PulseLine {
+ public:
+  bool high = false;
+  int edges = 0;
+
+  void set(bool level) override {
+    if (level != high) edges++;
+    high = level;
+  }
+};
+
+static int completions = 0;
+
+static void onDone(void* context) {
+  completions++;
+  *(int*)context += 1;
+}
+
+static void testFullPulse() {
+  MockTimer timer;
+  MockLine line;
+  int context = 0;
+  completions = 0;
+  ButtonPulse pulse(timer, line, onDone, &context);
+
+  TEST_ASSERT_TRUE(pulse.start(300));
+  TEST_ASSERT_TRUE(line.high);
+  TEST_ASSERT_TRUE(timer.armed);
+  TEST_ASSERT_EQUAL(300000, timer.armedUs);
+  TEST_ASSERT_TRUE(pulse.active());
+  TEST_ASSERT_EQUAL(0, completions);
+
+  timer.fire(pulse);
+  TEST_ASSERT_FALSE(line.high);
+  TEST_ASSERT_EQUAL(2, line.edges);
+  TEST_ASSERT_FALSE(pulse.active());
+  TEST_ASSERT_EQUAL(1, completions);
+  TEST_ASSERT_EQUAL(1, context);
+
+  // A late duplicate expiry is ignored
+  pulse.expire();
+  TEST_ASSERT_EQUAL(1, completions);
+  TEST_ASSERT_EQUAL(2, line.edges);
+}
+
+static void testStartWhileActive() {
+  MockTimer timer;
+  MockLine line;
+  int context = 0;
+  ButtonPulse pulse(timer, line, onDone, &context);
+
+  TEST_ASSERT_TRUE(pulse.start(300));
+  TEST_ASSERT_FALSE(pulse.start(300));
+  TEST_ASSERT_EQUAL(1, timer.armCount);
+  timer.fire(pulse);
+  TEST_ASSERT_TRUE(pulse.start(100));
+  TEST_ASSERT_EQUAL(100000, timer.armedUs);
+  timer.fire(pulse);
+  TEST_ASSERT_EQUAL(2, context);
+}
+
+static void testArmFailure() {
+  MockTimer timer;
+  MockLine line;
+  int context = 0;
+  ButtonPulse pulse(timer, line, onDone, &context);
+
+  timer.failArm = true;
+  TEST_ASSERT_FALSE(pulse.start(300));
+  TEST_ASSERT_FALSE(line.high);
+  TEST_ASSERT_FALSE(pulse.active());
+  TEST_ASSERT_EQUAL(0, context);
+
+  timer.failArm = false;
+  TEST_ASSERT_TRUE(pulse.start(300));
+  TEST_ASSERT_TRUE(line.high);
+}
+
+static void testAbort() {
+  MockTimer timer;
+  MockLine line;
+  int context = 0;
+  ButtonPulse pulse(timer, line, onDone, &context);
+
+  TEST_ASSERT_TRUE(pulse.start(300));
+  pulse.abort();
+  TEST_ASSERT_FALSE(line.high);
+  TEST_ASSERT_FALSE(timer.armed);
+  TEST_ASSERT_FALSE(pulse.active());
+  TEST_ASSERT_EQUAL(0, context);
+
+  // Aborting an idle pulse changes nothing
+  pulse.abort();
+  TEST_ASSERT_EQUAL(2, line.edges);
+}
+
+static void testNoCompletionCallback() {
+  MockTimer timer;
+  MockLine line;
+  ButtonPulse pulse(timer, line, nullptr, nullptr);
+
+  TEST_ASSERT_TRUE(pulse.start(50));
+  timer.fire(pulse);
+  TEST_ASSERT_FALSE(line.high);
+  TEST_ASSERT_FALSE(pulse.active());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testFullPulse);
+  RUN_TEST(testStartWhileActive);
+  RUN_TEST(testArmFailure);
+  RUN_TEST(testAbort);
+  RUN_TEST(testNoCompletionCallback);
+  return UNITY_END();
+}